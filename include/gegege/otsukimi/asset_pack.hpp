@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace gegege::otsukimi {
+
+// Bytes of one asset under data/, a view into the mounted pack or a loose file read into memory.
+struct AssetData {
+    const unsigned char* mData = nullptr;
+    size_t mSize = 0;
+    // set for loose files, released by freeAsset
+    void* mOwned = nullptr;
+};
+
+uint64_t hashAssetPath(std::string_view path);
+
+// Maps a pack written by writeAssetPack. Assets found in it are served from the mapping,
+// everything else still comes from loose files under data/, which keeps development without a pack working.
+bool mountAssetPack(const std::filesystem::path& packPath);
+
+void unmountAssetPack();
+
+bool isAssetInPack(const std::string& path);
+
+bool loadAsset(const std::string& path, AssetData& asset);
+
+void freeAsset(AssetData& asset);
+
+// modification time and size of the asset's source, the pack file's time for packed assets
+bool statAsset(const std::string& path, int64_t& time, uint64_t& size);
+
+// Packs every file below dataDir, keyed by its path relative to dataDir.
+bool writeAssetPack(const std::filesystem::path& dataDir, const std::filesystem::path& packPath);
+
+} // namespace gegege::otsukimi
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+// Skyline bottom-left rectangle packer.
+// The skyline is a list of horizontal segments covering the full page width,
+// each segment remembering the lowest free y coordinate above it.
+struct SkylinePacker {
+    struct Node {
+        int mX;
+        int mY;
+        int mWidth;
+    };
+
+    int mWidth;
+    int mHeight;
+    std::vector<Node> mSkyline;
+
+    void reset(int width, int height)
+    {
+        mWidth = width;
+        mHeight = height;
+        mSkyline.clear();
+        mSkyline.push_back({0, 0, width});
+    }
+
+    bool pack(int width, int height, int& outX, int& outY)
+    {
+        int bestIndex = -1;
+        int bestY = INT_MAX;
+        int bestWidth = INT_MAX;
+
+        for (int i = 0; i < (int)mSkyline.size(); ++i)
+        {
+            int y = fit(i, width, height);
+            if (y < 0)
+            {
+                continue;
+            }
+            // lowest resting position wins, the narrower segment breaks ties
+            if (y < bestY || (y == bestY && mSkyline[i].mWidth < bestWidth))
+            {
+                bestIndex = i;
+                bestY = y;
+                bestWidth = mSkyline[i].mWidth;
+            }
+        }
+
+        if (bestIndex < 0)
+        {
+            return false;
+        }
+
+        outX = mSkyline[bestIndex].mX;
+        outY = bestY;
+
+        Node node = {outX, bestY + height, width};
+        mSkyline.insert(mSkyline.begin() + bestIndex, node);
+
+        // trim the segments now covered by the new node
+        for (int i = bestIndex + 1; i < (int)mSkyline.size(); ++i)
+        {
+            Node& prev = mSkyline[i - 1];
+            Node& cur = mSkyline[i];
+            if (cur.mX >= prev.mX + prev.mWidth)
+            {
+                break;
+            }
+            int shrink = prev.mX + prev.mWidth - cur.mX;
+            cur.mX += shrink;
+            cur.mWidth -= shrink;
+            if (cur.mWidth <= 0)
+            {
+                mSkyline.erase(mSkyline.begin() + i);
+                --i;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        // merge neighbours of equal height
+        for (int i = 0; i + 1 < (int)mSkyline.size(); ++i)
+        {
+            if (mSkyline[i].mY == mSkyline[i + 1].mY)
+            {
+                mSkyline[i].mWidth += mSkyline[i + 1].mWidth;
+                mSkyline.erase(mSkyline.begin() + i + 1);
+                --i;
+            }
+        }
+
+        return true;
+    }
+
+    // returns the y at which a width x height rect rests when placed at segment index, or -1
+    int fit(int index, int width, int height) const
+    {
+        int x = mSkyline[index].mX;
+        if (x + width > mWidth)
+        {
+            return -1;
+        }
+
+        int y = 0;
+        int remaining = width;
+        for (int i = index; remaining > 0; ++i)
+        {
+            if (i >= (int)mSkyline.size())
+            {
+                return -1;
+            }
+            y = std::max(y, mSkyline[i].mY);
+            if (y + height > mHeight)
+            {
+                return -1;
+            }
+            remaining -= mSkyline[i].mWidth;
+        }
+        return y;
+    }
+};
+
+} // namespace gegege::otsukimi
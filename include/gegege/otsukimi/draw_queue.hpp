@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+// 64-bit draw command sort key, most significant field first:
+//   layer (16) | blend mode (4) | texture (20) | submission order (24)
+// Layers sort in ascending order. Texture is only filled in for layers that allow reordering,
+// elsewhere it stays 0 so the submission order decides. It holds a per-frame texture number rather than the GL name.
+constexpr uint64_t SORT_KEY_SEQUENCE_MASK = (uint64_t(1) << 24) - 1;
+constexpr size_t MAX_QUEUED_COMMANDS = size_t(1) << 24;
+
+inline uint64_t makeSortKey(int layer, unsigned int blend, unsigned int texture, uint32_t sequence)
+{
+    uint64_t biasedLayer = uint64_t(std::clamp(layer, -32768, 32767) + 32768);
+    return biasedLayer << 48 | uint64_t(blend & 0xF) << 44 | uint64_t(texture & 0xFFFFF) << 24 | (sequence & SORT_KEY_SEQUENCE_MASK);
+}
+
+// Frames are compared by an FNV-1a hash of everything they draw, taken a 32-bit word at a time.
+constexpr uint64_t FRAME_HASH_SEED = 14695981039346656037ull;
+
+inline uint64_t hashWords(uint64_t hash, const void* data, size_t numWords)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < numWords; ++i)
+    {
+        uint32_t word;
+        memcpy(&word, bytes + i * 4, 4);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// LSD radix sort with 8-bit digits.
+// Passes whose digit is the same for every key are skipped, and a queue that is already in order is left alone,
+// which is the usual case when scripts draw in layer order.
+inline void radixSortKeys(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch)
+{
+    size_t n = keys.size();
+    if (std::is_sorted(keys.begin(), keys.end()))
+    {
+        return;
+    }
+
+    size_t counts[8][256] = {};
+    for (uint64_t key : keys)
+    {
+        for (int pass = 0; pass < 8; ++pass)
+        {
+            counts[pass][(key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    scratch.resize(n);
+    uint64_t* src = keys.data();
+    uint64_t* dst = scratch.data();
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        int shift = pass * 8;
+        size_t* count = counts[pass];
+        if (count[(src[0] >> shift) & 0xFF] == n)
+        {
+            continue;
+        }
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            offsets[digit] = sum;
+            sum += count[digit];
+        }
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != keys.data())
+    {
+        memcpy(keys.data(), src, n * sizeof(uint64_t));
+    }
+}
+
+} // namespace gegege::otsukimi
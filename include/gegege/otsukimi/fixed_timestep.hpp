@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+
+namespace gegege::otsukimi {
+
+// Splits frame time into ticks of a fixed length, so simulation runs at the same rate on any display.
+// Time left over after the last whole tick carries into the next frame.
+struct FixedTimestep {
+    // ticks per second, 0 disables fixed updates
+    double mTickRate = 0.0;
+    // ticks run in one frame at most, time beyond that is dropped so a long stall does not snowball
+    int mMaxCatchUpTicks = 5;
+    double mAccumulator = 0.0;
+
+    void setTickRate(double ticksPerSecond)
+    {
+        mTickRate = std::max(ticksPerSecond, 0.0);
+        mAccumulator = 0.0;
+    }
+
+    // at least 1, with 0 no tick would ever run
+    void setMaxCatchUpTicks(int ticks)
+    {
+        mMaxCatchUpTicks = std::max(ticks, 1);
+    }
+
+    double getTickSeconds() const
+    {
+        return mTickRate > 0.0 ? 1.0 / mTickRate : 0.0;
+    }
+
+    // adds the frame's time and returns how many ticks to run for it
+    int advance(double dt)
+    {
+        if (mTickRate <= 0.0)
+        {
+            return 0;
+        }
+
+        double tick = getTickSeconds();
+        mAccumulator += dt;
+
+        int ticks = 0;
+        while (mAccumulator >= tick && ticks < mMaxCatchUpTicks)
+        {
+            mAccumulator -= tick;
+            ++ticks;
+        }
+        if (mAccumulator >= tick)
+        {
+            mAccumulator = 0.0;
+        }
+        return ticks;
+    }
+
+    // How far the present lies between the last tick and the next one, from 0 to 1.
+    // Rendering lerps between the previous and current simulated state by this.
+    float getInterpolationAlpha() const
+    {
+        return mTickRate > 0.0 ? float(mAccumulator * mTickRate) : 1.0f;
+    }
+};
+
+} // namespace gegege::otsukimi
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "gl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+
+namespace gegege::otsukimi {
+
+enum class PacingMode {
+    // presents on every vertical blank
+    VSync,
+    // vsync that tears instead of waiting a whole extra blank when a frame is late, plain vsync where unsupported
+    Adaptive,
+    // presents as soon as a frame is done
+    Uncapped,
+    // no vsync, frames are spaced by the frame limiter
+    Limited,
+};
+
+// the limiter sleeps until this close to the deadline and spins the rest, OS sleeps overshoot by about a millisecond
+constexpr uint64_t FRAME_LIMITER_SPIN_NS = 2 * SDL_NS_PER_MS;
+// present intervals kept for PacingStats
+constexpr size_t PRESENT_INTERVAL_HISTORY = 120;
+
+struct PacingStats {
+    // intervals measured, up to PRESENT_INTERVAL_HISTORY
+    uint32_t mSamples;
+    double mMeanMS;
+    double mMinMS;
+    double mMaxMS;
+    // standard deviation of the intervals
+    double mJitterMS;
+};
+
+// Sets the swap interval for the pacing mode, spaces frames in limited mode,
+// caps how many presented frames the GPU may be behind and measures the time between presents.
+struct FramePacer {
+    PacingMode mMode = PacingMode::Adaptive;
+    double mFrameRateLimit = 60.0;
+    uint64_t mNextDeadline = 0;
+
+    // After each present the CPU waits until fewer than this many presented frames are unfinished on the GPU.
+    // 1 waits for every frame to finish like glFinish, 0 leaves the driver's queue alone.
+    unsigned int mMaxQueuedFrames = 0;
+    std::deque<GLsync> mQueuedFrames;
+
+    uint64_t mLastPresent = 0;
+    std::deque<uint64_t> mPresentIntervals;
+
+    void setMode(PacingMode mode)
+    {
+        mMode = mode;
+        mNextDeadline = 0;
+
+        int interval = 0;
+        if (mode == PacingMode::VSync)
+        {
+            interval = 1;
+        }
+        else if (mode == PacingMode::Adaptive)
+        {
+            interval = -1;
+        }
+
+        if (!SDL_GL_SetSwapInterval(interval))
+        {
+            SDL_Log("VSYNC: %s", SDL_GetError());
+            if (interval == -1 && !SDL_GL_SetSwapInterval(1))
+            {
+                SDL_Log("VSYNC: %s", SDL_GetError());
+            }
+        }
+    }
+
+    void setFrameRateLimit(double fps)
+    {
+        mFrameRateLimit = fps;
+        mNextDeadline = 0;
+    }
+
+    void setMaxQueuedFrames(unsigned int frames)
+    {
+        mMaxQueuedFrames = frames;
+        if (frames == 0)
+        {
+            for (GLsync fence : mQueuedFrames)
+            {
+                glDeleteSync(fence);
+            }
+            mQueuedFrames.clear();
+        }
+    }
+
+    // called right before the swap, holds the frame back until its slot in limited mode
+    void waitForPresent()
+    {
+        if (mMode != PacingMode::Limited || mFrameRateLimit <= 0.0)
+        {
+            return;
+        }
+
+        uint64_t period = uint64_t(SDL_NS_PER_SECOND / mFrameRateLimit);
+        uint64_t now = SDL_GetTicksNS();
+        // a frame that missed its slot by more than a period starts a new schedule instead of rushing to catch up
+        if (mNextDeadline == 0 || now > mNextDeadline + period)
+        {
+            mNextDeadline = now;
+        }
+
+        if (mNextDeadline > now + FRAME_LIMITER_SPIN_NS)
+        {
+            SDL_DelayNS(mNextDeadline - now - FRAME_LIMITER_SPIN_NS);
+        }
+        while (SDL_GetTicksNS() < mNextDeadline)
+        {
+        }
+
+        mNextDeadline += period;
+    }
+
+    // called right after the swap
+    void framePresented()
+    {
+        uint64_t now = SDL_GetTicksNS();
+        if (mLastPresent)
+        {
+            mPresentIntervals.push_back(now - mLastPresent);
+            if (mPresentIntervals.size() > PRESENT_INTERVAL_HISTORY)
+            {
+                mPresentIntervals.pop_front();
+            }
+        }
+        mLastPresent = now;
+
+        if (mMaxQueuedFrames == 0)
+        {
+            return;
+        }
+        mQueuedFrames.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        while (mQueuedFrames.size() >= mMaxQueuedFrames)
+        {
+            GLsync fence = mQueuedFrames.front();
+            mQueuedFrames.pop_front();
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+            glDeleteSync(fence);
+        }
+    }
+
+    // A frame that was not presented, the next interval would include the idle time, so it is not measured.
+    void frameSkipped()
+    {
+        mLastPresent = 0;
+        mNextDeadline = 0;
+    }
+
+    PacingStats getStats() const
+    {
+        PacingStats stats = {};
+        stats.mSamples = uint32_t(mPresentIntervals.size());
+        if (mPresentIntervals.empty())
+        {
+            return stats;
+        }
+
+        double sum = 0.0;
+        stats.mMinMS = double(mPresentIntervals.front()) / SDL_NS_PER_MS;
+        for (uint64_t i : mPresentIntervals)
+        {
+            double ms = double(i) / SDL_NS_PER_MS;
+            sum += ms;
+            stats.mMinMS = std::min(stats.mMinMS, ms);
+            stats.mMaxMS = std::max(stats.mMaxMS, ms);
+        }
+        stats.mMeanMS = sum / stats.mSamples;
+
+        double variance = 0.0;
+        for (uint64_t i : mPresentIntervals)
+        {
+            double delta = double(i) / SDL_NS_PER_MS - stats.mMeanMS;
+            variance += delta * delta;
+        }
+        stats.mJitterMS = std::sqrt(variance / stats.mSamples);
+        return stats;
+    }
+
+    void shutdown()
+    {
+        setMaxQueuedFrames(0);
+    }
+};
+
+} // namespace gegege::otsukimi
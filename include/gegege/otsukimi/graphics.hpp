@@ -14,18 +14,105 @@ void setScreenWidth(int width);
 
 void setScreenHeight(int height);
 
-Texture* textureFind(const std::string& path);
+// Draws frames straight into the window even when it is scaled, instead of through the offscreen buffer.
+// Frames whose window size matches the offscreen size always do.
+void setDirectRendering(bool enabled);
+
+// With redraw on demand a frame that draws the same as the last presented one is not presented,
+// and the app sleeps until input arrives or the minimum frame rate (0 for none) is due.
+void setRedrawOnDemand(bool enabled);
+
+void setMinFrameRate(float fps);
+
+// presents the next frame even if its draw commands are unchanged
+void requestRedraw();
+
+// Textures and fonts looked up from C++ are pinned and stay loaded until shutdown.
+// The Lua bindings pass pin = false, their userdata hold references instead.
+Texture* textureFind(const std::string& path, bool pin = true);
+
+Texture* textureFindAsync(const std::string& path, bool pin = true);
+
+bool isTextureLoaded(Texture* tex);
+
+void setTextureUploadBudget(size_t bytes);
+
+Texture* createDynamicTexture(int width, int height, bool pin = true);
+
+void updateDynamicTexture(Texture* tex, const unsigned char* pixels);
+
+void setTextureFilter(Texture* tex, bool linear, bool mipmaps);
+
+void setTextureMipmapsOnLoad(bool enabled);
+
+void setTextureBudget(size_t bytes);
+
+TextureStats getTextureStats();
+
+void setTextureAtlasEnabled(bool enabled);
+
+void textureAtlasGroup(const std::string& group, const std::vector<std::string>& paths);
 
 int getTextureWidth(Texture* tex);
 
 int getTextureHeight(Texture* tex);
 
-void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a);
+// r, g, b and a multiply the texture color and are clamped to [0, 1], a tint cannot brighten the texture
+void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a, int layer = 0);
 
-TTF_Font* fontFind(const std::string& path, float ptSize);
+void drawTextures(const SpriteDesc* sprites, size_t count, int layer = 0);
+
+void setLayerReorder(int layer, bool enabled);
+
+TTF_Font* fontFind(const std::string& path, float ptSize, bool pin = true);
 
 void drawText(TTF_Font* font, float x, float y, const std::string& text, float r, float g, float b, float a);
 
 void setFontOutline(TTF_Font* font, int outline);
 
+void measureText(TTF_Font* font, const std::string& text, int wrapWidth, int& outWidth, int& outHeight);
+
+TextObject* createText(TTF_Font* font, const std::string& text, int wrapWidth = 0);
+
+void updateText(TextObject* obj, const std::string& text, int wrapWidth = 0);
+
+void drawTextObject(TextObject* obj, float x, float y, float r, float g, float b, float a);
+
+int getTextObjectWidth(TextObject* obj);
+
+int getTextObjectHeight(TextObject* obj);
+
+void destroyText(TextObject* obj);
+
+RenderStats getRenderStats();
+
+// batching settings, they take effect from the next frame
+void setInstancedSprites(bool enabled);
+
+void setMaxBatchQuads(size_t quads);
+
+void setTextureSlots(unsigned int slots);
+
+// Handles stay safe to hold after the object is gone, resolving them then returns nullptr.
+Handle getTextureHandle(Texture* tex);
+
+Texture* resolveTexture(Handle handle);
+
+Handle getFontHandle(TTF_Font* font);
+
+TTF_Font* resolveFont(Handle handle);
+
+Handle getTextHandle(TextObject* obj);
+
+TextObject* resolveText(Handle handle);
+
+// A retained texture or font is unloaded at the start of the frame after its last release, unless it is pinned.
+void retainTexture(Texture* tex);
+
+void releaseTexture(Texture* tex);
+
+void retainFont(TTF_Font* font);
+
+void releaseFont(TTF_Font* font);
+
 } // namespace gegege::otsukimi
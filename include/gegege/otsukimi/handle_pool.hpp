@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+// Generation in the high 32 bits, slot index in the low 32 bits.
+// Generations start at 1, so 0 is never a valid handle.
+using Handle = uint64_t;
+
+// Fixed size chunks of slots with a free list.
+// Objects never move, so T* stays usable on the C++ side while scripts hold handles,
+// and a handle to a released slot is detected by its generation instead of dangling.
+template <typename T>
+struct HandlePool {
+    static constexpr uint32_t CHUNK_SIZE = 256;
+
+    // Each object sits at the start of a slot that also records the slot's index,
+    // so the handle of a T* is found without searching the chunks.
+    struct Slot {
+        T mValue;
+        uint32_t mIndex;
+    };
+    static_assert(std::is_standard_layout_v<Slot>, "a T* has to be convertible to its Slot*");
+
+    std::vector<std::unique_ptr<Slot[]>> mChunks;
+    std::vector<uint32_t> mGenerations;
+    std::vector<bool> mLive;
+    std::vector<uint32_t> mFreeIndices;
+
+    // returns a value-initialized object
+    T* allocate()
+    {
+        uint32_t index;
+        if (!mFreeIndices.empty())
+        {
+            index = mFreeIndices.back();
+            mFreeIndices.pop_back();
+        }
+        else
+        {
+            index = uint32_t(mGenerations.size());
+            if (index % CHUNK_SIZE == 0)
+            {
+                mChunks.push_back(std::make_unique<Slot[]>(CHUNK_SIZE));
+            }
+            mChunks.back()[index % CHUNK_SIZE].mIndex = index;
+            mGenerations.push_back(1);
+            mLive.push_back(false);
+        }
+
+        mLive[index] = true;
+        T* value = &at(index);
+        *value = T();
+        return value;
+    }
+
+    void release(T* value)
+    {
+        uint32_t index = indexOf(value);
+        *value = T();
+        mLive[index] = false;
+        // skip 0 on wrap around so released handles stay invalid
+        if (++mGenerations[index] == 0)
+        {
+            mGenerations[index] = 1;
+        }
+        mFreeIndices.push_back(index);
+    }
+
+    // nullptr for handles whose object was released
+    T* get(Handle handle)
+    {
+        uint32_t index = uint32_t(handle);
+        uint32_t generation = uint32_t(handle >> 32);
+        if (index >= mGenerations.size() || !mLive[index] || mGenerations[index] != generation)
+        {
+            return nullptr;
+        }
+        return &at(index);
+    }
+
+    // returns 0 for nullptr
+    Handle handleOf(const T* value)
+    {
+        uint32_t index = indexOf(value);
+        if (index == UINT32_MAX)
+        {
+            return 0;
+        }
+        return Handle(mGenerations[index]) << 32 | index;
+    }
+
+    T& at(uint32_t index)
+    {
+        return mChunks[index / CHUNK_SIZE][index % CHUNK_SIZE].mValue;
+    }
+
+    // value has to come from this pool
+    uint32_t indexOf(const T* value)
+    {
+        if (!value)
+        {
+            return UINT32_MAX;
+        }
+        return reinterpret_cast<const Slot*>(value)->mIndex;
+    }
+};
+
+} // namespace gegege::otsukimi
@@ -28,30 +28,25 @@ int lua_myRequire(lua_State* L)
     {
         lua_pop(lua.mL, 1);
 
-        std::filesystem::path path = SDL_GetBasePath();
-        // set data/?.lua
-        path.append("data");
-        path.append(modname + ".lua");
-        const char* code = (const char*)SDL_LoadFile(path.generic_string().c_str(), NULL);
-
-        if (!code)
+        // data/?.lua, then data/?/init.lua, from the asset pack or loose files
+        std::string chunkPath = modname + ".lua";
+        AssetData code;
+        if (!loadAsset(chunkPath, code))
         {
-            path = SDL_GetBasePath();
-            path.append("data");
-            path.append(modname);
-            path.append("init.lua");
-            code = (const char*)SDL_LoadFile(path.generic_string().c_str(), NULL);
-            if (!code)
+            chunkPath = modname + "/init.lua";
+            if (!loadAsset(chunkPath, code))
             {
                 luaL_error(lua.mL, "Lua Engine: Failed to prepare file: %s", modname.c_str());
                 return 0;
             }
         }
 
-        if (luaL_loadstring(lua.mL, code) != LUA_OK)
+        std::string chunkName = "@" + chunkPath;
+        if (luaL_loadbuffer(lua.mL, (const char*)code.mData, code.mSize, chunkName.c_str()) != LUA_OK)
         {
             SDL_Log("Lua Engine: Failed to prepare script: %s", lua.popString().c_str());
         }
+        freeAsset(code);
         lua.pcall(0, 1);
 
         if (lua_type(lua.mL, -1) != LUA_TNIL)
@@ -91,20 +86,53 @@ struct LuaApp : Otsukimi {
         mLuaEngine.startup();
         mLuaEngine.openlibs();
 
+        registerGraphicsTypes(mLuaEngine.mL);
+
         lua_register(mLuaEngine.mL, "require", lua_myRequire);
         lua_register(mLuaEngine.mL, "getMouseCoordinateToScreenCoordinateX", lua_getMouseCoordinateToScreenCoordinateX);
         lua_register(mLuaEngine.mL, "getMouseCoordinateToScreenCoordinateY", lua_getMouseCoordinateToScreenCoordinateY);
+        lua_register(mLuaEngine.mL, "setTickRate", lua_setTickRate);
+        lua_register(mLuaEngine.mL, "setMaxCatchUpTicks", lua_setMaxCatchUpTicks);
+        lua_register(mLuaEngine.mL, "getInterpolationAlpha", lua_getInterpolationAlpha);
+        lua_register(mLuaEngine.mL, "setPacingMode", lua_setPacingMode);
+        lua_register(mLuaEngine.mL, "setFrameRateLimit", lua_setFrameRateLimit);
+        lua_register(mLuaEngine.mL, "setMaxQueuedFrames", lua_setMaxQueuedFrames);
+        lua_register(mLuaEngine.mL, "getPacingStats", lua_getPacingStats);
         lua_register(mLuaEngine.mL, "setOffscreenWidth", lua_setOffscreenWidth);
         lua_register(mLuaEngine.mL, "setOffscreenHeight", lua_setOffscreenHeight);
         lua_register(mLuaEngine.mL, "setScreenWidth", lua_setScreenWidth);
         lua_register(mLuaEngine.mL, "setScreenHeight", lua_setScreenHeight);
+        lua_register(mLuaEngine.mL, "setDirectRendering", lua_setDirectRendering);
+        lua_register(mLuaEngine.mL, "setRedrawOnDemand", lua_setRedrawOnDemand);
+        lua_register(mLuaEngine.mL, "setMinFrameRate", lua_setMinFrameRate);
+        lua_register(mLuaEngine.mL, "requestRedraw", lua_requestRedraw);
         lua_register(mLuaEngine.mL, "textureFind", lua_textureFind);
-        lua_register(mLuaEngine.mL, "getTextureWidth", lua_getTextureWidth);
-        lua_register(mLuaEngine.mL, "getTextureHeight", lua_getTextureHeight);
+        lua_register(mLuaEngine.mL, "textureFindAsync", lua_textureFindAsync);
+        lua_register(mLuaEngine.mL, "isTextureLoaded", lua_isTextureLoaded);
+        lua_register(mLuaEngine.mL, "setTextureUploadBudget", lua_setTextureUploadBudget);
+        lua_register(mLuaEngine.mL, "createDynamicTexture", lua_createDynamicTexture);
+        lua_register(mLuaEngine.mL, "updateDynamicTexture", lua_updateDynamicTexture);
+        lua_register(mLuaEngine.mL, "setTextureAtlasEnabled", lua_setTextureAtlasEnabled);
+        lua_register(mLuaEngine.mL, "textureAtlasGroup", lua_textureAtlasGroup);
+        lua_register(mLuaEngine.mL, "setTextureFilter", lua_setTextureFilter);
+        lua_register(mLuaEngine.mL, "setTextureMipmapsOnLoad", lua_setTextureMipmapsOnLoad);
+        lua_register(mLuaEngine.mL, "setTextureBudget", lua_setTextureBudget);
+        lua_register(mLuaEngine.mL, "getTextureStats", lua_getTextureStats);
         lua_register(mLuaEngine.mL, "drawTexture", lua_drawTexture);
+        lua_register(mLuaEngine.mL, "drawTextures", lua_drawTextures);
         lua_register(mLuaEngine.mL, "fontFind", lua_fontFind);
         lua_register(mLuaEngine.mL, "drawText", lua_drawText);
         lua_register(mLuaEngine.mL, "setFontOutline", lua_setFontOutline);
+        lua_register(mLuaEngine.mL, "measureText", lua_measureText);
+        lua_register(mLuaEngine.mL, "createText", lua_createText);
+        lua_register(mLuaEngine.mL, "updateText", lua_updateText);
+        lua_register(mLuaEngine.mL, "drawTextObject", lua_drawTextObject);
+        lua_register(mLuaEngine.mL, "getTextObjectWidth", lua_getTextObjectWidth);
+        lua_register(mLuaEngine.mL, "getTextObjectHeight", lua_getTextObjectHeight);
+        lua_register(mLuaEngine.mL, "destroyText", lua_destroyText);
+        lua_register(mLuaEngine.mL, "getRenderStats", lua_getRenderStats);
+        lua_register(mLuaEngine.mL, "setInstancedSprites", lua_setInstancedSprites);
+        lua_register(mLuaEngine.mL, "setLayerReorder", lua_setLayerReorder);
 
         std::filesystem::path path = SDL_GetBasePath();
         SDL_Log("Base Path: %s", path.generic_string().c_str());
@@ -126,16 +154,25 @@ struct LuaApp : Otsukimi {
 
         mLuaEngine.setTable("package", "path", gegege::lua::LuaString::make(pkgPath));
 
-        path = SDL_GetBasePath();
-        path.append("data");
-        path.append("main.lua");
-
-        mLuaEngine.executeFile(path.generic_string().c_str());
+        AssetData code;
+        if (!loadAsset("main.lua", code))
+        {
+            SDL_Log("Lua Engine: Failed to prepare file: %s", SDL_GetError());
+            return;
+        }
+        if (luaL_loadbuffer(mLuaEngine.mL, (const char*)code.mData, code.mSize, "@main.lua") != LUA_OK)
+        {
+            SDL_Log("Lua Engine: Failed to prepare script: %s", mLuaEngine.popString().c_str());
+        }
+        freeAsset(code);
+        mLuaEngine.pcall();
     }
 
     void shutdown() override
     {
         mLuaEngine.shutdown();
+
+        Otsukimi::shutdown();
     }
 
     void onLoad() override
@@ -234,6 +271,16 @@ struct LuaApp : Otsukimi {
         }
     }
 
+    void onFixedUpdate(float dt) override
+    {
+        int type = lua_getglobal(mLuaEngine.mL, "onFixedUpdate");
+        mLuaEngine.popValue();
+        if (type == LUA_TFUNCTION)
+        {
+            mLuaEngine.call("onFixedUpdate", gegege::lua::LuaNumber::make(dt));
+        }
+    }
+
     void onUpdate(float dt) override
     {
         int type = lua_getglobal(mLuaEngine.mL, "onUpdate");
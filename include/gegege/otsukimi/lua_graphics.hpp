@@ -5,6 +5,180 @@
 
 namespace gegege::otsukimi {
 
+constexpr const char* TEXTURE_METATABLE = "otsukimi.Texture";
+constexpr const char* FONT_METATABLE = "otsukimi.Font";
+
+// Textures and fonts reach scripts as full userdata holding a handle and one reference.
+// Every lookup returns a userdata of its own, so __close on one of them drops only that userdata's reference
+// and leaves the object usable through the others. __eq compares the objects they refer to.
+inline void pushHandleUserdata(lua_State* L, const char* metatable, Handle handle)
+{
+    Handle* value = (Handle*)lua_newuserdatauv(L, sizeof(Handle), 0);
+    *value = handle;
+    luaL_setmetatable(L, metatable);
+}
+
+inline void pushTexture(lua_State* L, Texture* tex)
+{
+    if (!tex)
+    {
+        lua_pushnil(L);
+        return;
+    }
+    pushHandleUserdata(L, TEXTURE_METATABLE, getTextureHandle(tex));
+    retainTexture(tex);
+}
+
+inline Texture* toTexture(lua_State* L, int index)
+{
+    Handle* handle = (Handle*)luaL_testudata(L, index, TEXTURE_METATABLE);
+    Texture* tex = handle ? resolveTexture(*handle) : nullptr;
+    if (!tex)
+    {
+        SDL_Log("Invalid texture");
+    }
+    return tex;
+}
+
+inline void pushFont(lua_State* L, TTF_Font* font)
+{
+    if (!font)
+    {
+        lua_pushnil(L);
+        return;
+    }
+    pushHandleUserdata(L, FONT_METATABLE, getFontHandle(font));
+    retainFont(font);
+}
+
+inline TTF_Font* toFont(lua_State* L, int index)
+{
+    Handle* handle = (Handle*)luaL_testudata(L, index, FONT_METATABLE);
+    TTF_Font* font = handle ? resolveFont(*handle) : nullptr;
+    if (!font)
+    {
+        SDL_Log("Invalid font");
+    }
+    return font;
+}
+
+// __gc and __close, a closed userdata is invalid for the rest of the script
+inline int lua_textureRelease(lua_State* L)
+{
+    Handle* handle = (Handle*)luaL_checkudata(L, 1, TEXTURE_METATABLE);
+    if (Texture* tex = resolveTexture(*handle))
+    {
+        releaseTexture(tex);
+    }
+    *handle = 0;
+    return 0;
+}
+
+inline int lua_fontRelease(lua_State* L)
+{
+    Handle* handle = (Handle*)luaL_checkudata(L, 1, FONT_METATABLE);
+    if (TTF_Font* font = resolveFont(*handle))
+    {
+        releaseFont(font);
+    }
+    *handle = 0;
+    return 0;
+}
+
+// __eq for userdata of the same type
+inline int lua_handleEqual(lua_State* L)
+{
+    Handle* a = (Handle*)lua_touserdata(L, 1);
+    Handle* b = (Handle*)lua_touserdata(L, 2);
+    bool sameType = lua_getmetatable(L, 1) && lua_getmetatable(L, 2) && lua_rawequal(L, -1, -2);
+    lua_pushboolean(L, sameType && a && b && *a == *b);
+    return 1;
+}
+
+// tex:width()
+inline int lua_textureWidth(lua_State* L)
+{
+    Texture* tex = toTexture(L, 1);
+    if (!tex)
+    {
+        return 0;
+    }
+    lua_pushinteger(L, getTextureWidth(tex));
+    return 1;
+}
+
+// tex:height()
+inline int lua_textureHeight(lua_State* L)
+{
+    Texture* tex = toTexture(L, 1);
+    if (!tex)
+    {
+        return 0;
+    }
+    lua_pushinteger(L, getTextureHeight(tex));
+    return 1;
+}
+
+inline void registerHandleType(lua_State* L, const char* metatable, const luaL_Reg* metamethods, const luaL_Reg* methods)
+{
+    luaL_newmetatable(L, metatable);
+    luaL_setfuncs(L, metamethods, 0);
+    lua_newtable(L);
+    luaL_setfuncs(L, methods, 0);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+}
+
+inline void registerGraphicsTypes(lua_State* L)
+{
+    const luaL_Reg textureMetamethods[] = {
+        {"__gc", lua_textureRelease},
+        {"__close", lua_textureRelease},
+        {"__eq", lua_handleEqual},
+        {nullptr, nullptr},
+    };
+    const luaL_Reg textureMethods[] = {
+        {"width", lua_textureWidth},
+        {"height", lua_textureHeight},
+        {nullptr, nullptr},
+    };
+    registerHandleType(L, TEXTURE_METATABLE, textureMetamethods, textureMethods);
+
+    const luaL_Reg fontMetamethods[] = {
+        {"__gc", lua_fontRelease},
+        {"__close", lua_fontRelease},
+        {"__eq", lua_handleEqual},
+        {nullptr, nullptr},
+    };
+    const luaL_Reg fontMethods[] = {
+        {nullptr, nullptr},
+    };
+    registerHandleType(L, FONT_METATABLE, fontMetamethods, fontMethods);
+}
+
+// Text objects are destroyed explicitly with destroyText, scripts hold their handle as an integer.
+inline void pushText(lua_State* L, TextObject* obj)
+{
+    if (Handle handle = getTextHandle(obj))
+    {
+        lua_pushinteger(L, lua_Integer(handle));
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+}
+
+inline TextObject* toText(lua_State* L, int index)
+{
+    TextObject* obj = resolveText(Handle(lua_tointeger(L, index)));
+    if (!obj)
+    {
+        SDL_Log("Invalid text handle");
+    }
+    return obj;
+}
+
 inline int lua_setOffscreenWidth(lua_State* L)
 {
     lua::LuaEngine lua;
@@ -53,39 +227,218 @@ inline int lua_setScreenHeight(lua_State* L)
     return 0;
 }
 
+inline int lua_setDirectRendering(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+
+    lua::LuaValue enabled = lua.popValue();
+
+    setDirectRendering(std::get<lua::LuaBoolean>(enabled).mValue);
+
+    return 0;
+}
+
+inline int lua_setRedrawOnDemand(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+
+    lua::LuaValue enabled = lua.popValue();
+
+    setRedrawOnDemand(std::get<lua::LuaBoolean>(enabled).mValue);
+
+    return 0;
+}
+
+inline int lua_setMinFrameRate(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+
+    lua::LuaValue fps = lua.popValue();
+
+    setMinFrameRate(std::get<lua::LuaNumber>(fps).mValue);
+
+    return 0;
+}
+
+inline int lua_requestRedraw(lua_State* L)
+{
+    requestRedraw();
+    return 0;
+}
+
 inline int lua_textureFind(lua_State* L)
 {
     lua::LuaEngine lua;
     lua.mL = L;
     lua::LuaValue path = lua.popValue();
-    Texture* tex = textureFind(lua::getLuaValueString(path));
-    lua_pushlightuserdata(L, tex);
+    Texture* tex = textureFind(lua::getLuaValueString(path), false);
+    pushTexture(L, tex);
     return 1;
 }
 
-inline int lua_getTextureWidth(lua_State* L)
+inline int lua_textureFindAsync(lua_State* L)
 {
     lua::LuaEngine lua;
     lua.mL = L;
-    Texture* tex = (Texture*)lua_touserdata(L, -1);
-    lua.pushValue(lua::LuaNumber::make(getTextureWidth(tex)));
+    lua::LuaValue path = lua.popValue();
+    Texture* tex = textureFindAsync(lua::getLuaValueString(path), false);
+    pushTexture(L, tex);
     return 1;
 }
 
-inline int lua_getTextureHeight(lua_State* L)
+inline int lua_isTextureLoaded(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    Texture* tex = toTexture(L, -1);
+    if (!tex)
+    {
+        return 0;
+    }
+    lua.pushValue(lua::LuaBoolean::make(isTextureLoaded(tex)));
+    return 1;
+}
+
+inline int lua_setTextureUploadBudget(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue bytes = lua.popValue();
+    setTextureUploadBudget(std::get<lua::LuaNumber>(bytes).mValue);
+    return 0;
+}
+
+inline int lua_createDynamicTexture(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue height = lua.popValue();
+    lua::LuaValue width = lua.popValue();
+    Texture* tex = createDynamicTexture(std::get<lua::LuaNumber>(width).mValue, std::get<lua::LuaNumber>(height).mValue, false);
+    pushTexture(L, tex);
+    return 1;
+}
+
+// updateDynamicTexture(tex, pixels), pixels is a string of width * height * 4 RGBA bytes
+inline int lua_updateDynamicTexture(lua_State* L)
+{
+    size_t numBytes;
+    const char* pixels = lua_tolstring(L, -1, &numBytes);
+    Texture* tex = toTexture(L, -2);
+    if (!tex)
+    {
+        return 0;
+    }
+    lua_pop(L, 2);
+
+    if (!pixels || numBytes != size_t(getTextureWidth(tex)) * getTextureHeight(tex) * 4)
+    {
+        SDL_Log("updateDynamicTexture: expected %d bytes of RGBA pixels", getTextureWidth(tex) * getTextureHeight(tex) * 4);
+        return 0;
+    }
+
+    updateDynamicTexture(tex, (const unsigned char*)pixels);
+    return 0;
+}
+
+inline int lua_setTextureAtlasEnabled(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue enabled = lua.popValue();
+    setTextureAtlasEnabled(std::get<lua::LuaBoolean>(enabled).mValue);
+    return 0;
+}
+
+inline int lua_textureAtlasGroup(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+
+    std::vector<std::string> paths;
+    lua_Integer n = lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= n; ++i)
+    {
+        lua_rawgeti(L, -1, i);
+        paths.push_back(lua::getLuaValueString(lua.popValue()));
+    }
+    lua_pop(L, 1);
+
+    lua::LuaValue group = lua.popValue();
+    textureAtlasGroup(lua::getLuaValueString(group), paths);
+    return 0;
+}
+
+// setTextureFilter(tex, "nearest" or "linear", mipmaps)
+inline int lua_setTextureFilter(lua_State* L)
 {
     lua::LuaEngine lua;
     lua.mL = L;
-    Texture* tex = (Texture*)lua_touserdata(L, -1);
-    lua.pushValue(lua::LuaNumber::make(getTextureHeight(tex)));
+    lua::LuaValue mipmaps = lua.popValue();
+    lua::LuaValue filter = lua.popValue();
+    Texture* tex = toTexture(L, -1);
+    if (!tex)
+    {
+        return 0;
+    }
+    setTextureFilter(tex, lua::getLuaValueString(filter) == "linear", std::get<lua::LuaBoolean>(mipmaps).mValue);
+    return 0;
+}
+
+inline int lua_setTextureMipmapsOnLoad(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue enabled = lua.popValue();
+    setTextureMipmapsOnLoad(std::get<lua::LuaBoolean>(enabled).mValue);
+    return 0;
+}
+
+// setTextureBudget(bytes), 0 disables eviction
+inline int lua_setTextureBudget(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue bytes = lua.popValue();
+    setTextureBudget(std::get<lua::LuaNumber>(bytes).mValue);
+    return 0;
+}
+
+inline int lua_getTextureStats(lua_State* L)
+{
+    TextureStats stats = getTextureStats();
+    lua_newtable(L);
+    lua_pushnumber(L, stats.mHits);
+    lua_setfield(L, -2, "hits");
+    lua_pushnumber(L, stats.mMisses);
+    lua_setfield(L, -2, "misses");
+    lua_pushnumber(L, stats.mEvictions);
+    lua_setfield(L, -2, "evictions");
+    lua_pushnumber(L, stats.mReloads);
+    lua_setfield(L, -2, "reloads");
+    lua_pushnumber(L, stats.mResidentBytes);
+    lua_setfield(L, -2, "residentBytes");
+    lua_pushnumber(L, stats.mBudgetBytes);
+    lua_setfield(L, -2, "budgetBytes");
     return 1;
 }
 
+// drawTexture(tex, sx, sy, sw, sh, scaleX, scaleY, angle, dx, dy, r, g, b, a [, layer])
+// r, g, b and a are clamped to [0, 1]
 inline int lua_drawTexture(lua_State* L)
 {
     lua::LuaEngine lua;
     lua.mL = L;
 
+    int layer = 0;
+    if (lua_gettop(L) >= 15)
+    {
+        layer = std::get<lua::LuaNumber>(lua.popValue()).mValue;
+    }
+
     lua::LuaValue a = lua.popValue();
     lua::LuaValue b = lua.popValue();
     lua::LuaValue g = lua.popValue();
@@ -104,14 +457,55 @@ inline int lua_drawTexture(lua_State* L)
     lua::LuaValue sy = lua.popValue();
     lua::LuaValue sx = lua.popValue();
 
-    Texture* tex = (Texture*)lua_touserdata(L, -1);
+    Texture* tex = toTexture(L, -1);
+    if (!tex)
+    {
+        return 0;
+    }
 
     drawTexture(tex,
                 std::get<lua::LuaNumber>(sx).mValue, std::get<lua::LuaNumber>(sy).mValue, std::get<lua::LuaNumber>(sw).mValue, std::get<lua::LuaNumber>(sh).mValue,
                 std::get<lua::LuaNumber>(scaleX).mValue, std::get<lua::LuaNumber>(scaleY).mValue,
                 std::get<lua::LuaNumber>(angle).mValue,
                 std::get<lua::LuaNumber>(dx).mValue, std::get<lua::LuaNumber>(dy).mValue,
-                std::get<lua::LuaNumber>(r).mValue, std::get<lua::LuaNumber>(g).mValue, std::get<lua::LuaNumber>(b).mValue, std::get<lua::LuaNumber>(a).mValue);
+                std::get<lua::LuaNumber>(r).mValue, std::get<lua::LuaNumber>(g).mValue, std::get<lua::LuaNumber>(b).mValue, std::get<lua::LuaNumber>(a).mValue,
+                layer);
+    return 0;
+}
+
+// drawTextures(tex, {sx, sy, sw, sh, scaleX, scaleY, angle, dx, dy, r, g, b, a, sx, sy, ...} [, layer])
+// takes a flat array with 13 numbers per sprite, laid out like the drawTexture arguments
+inline int lua_drawTextures(lua_State* L)
+{
+    int layer = 0;
+    if (lua_gettop(L) >= 3)
+    {
+        layer = (int)lua_tointeger(L, 3);
+        lua_pop(L, 1);
+    }
+
+    Texture* tex = toTexture(L, -2);
+    if (!tex)
+    {
+        return 0;
+    }
+
+    lua_Integer n = lua_rawlen(L, -1) / 13;
+    std::vector<SpriteDesc> sprites(n);
+    for (lua_Integer i = 0; i < n; ++i)
+    {
+        float values[13];
+        for (int k = 0; k < 13; ++k)
+        {
+            lua_rawgeti(L, -1, i * 13 + k + 1);
+            values[k] = lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+        sprites[i] = {tex, values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7], values[8], values[9], values[10], values[11], values[12]};
+    }
+    lua_pop(L, 2);
+
+    drawTextures(sprites.data(), sprites.size(), layer);
     return 0;
 }
 
@@ -121,8 +515,8 @@ inline int lua_fontFind(lua_State* L)
     lua.mL = L;
     lua::LuaValue ptSize = lua.popValue();
     lua::LuaValue path = lua.popValue();
-    TTF_Font* font = fontFind(lua::getLuaValueString(path), std::get<lua::LuaNumber>(ptSize).mValue);
-    lua_pushlightuserdata(L, font);
+    TTF_Font* font = fontFind(lua::getLuaValueString(path), std::get<lua::LuaNumber>(ptSize).mValue, false);
+    pushFont(L, font);
     return 1;
 }
 
@@ -137,7 +531,11 @@ inline int lua_drawText(lua_State* L)
     lua::LuaValue text = lua.popValue();
     lua::LuaValue y = lua.popValue();
     lua::LuaValue x = lua.popValue();
-    TTF_Font* font = (TTF_Font*)lua_touserdata(L, -1);
+    TTF_Font* font = toFont(L, -1);
+    if (!font)
+    {
+        return 0;
+    }
     drawText(font, std::get<lua::LuaNumber>(x).mValue, std::get<lua::LuaNumber>(y).mValue,
              lua::getLuaValueString(text),
              std::get<lua::LuaNumber>(r).mValue, std::get<lua::LuaNumber>(g).mValue, std::get<lua::LuaNumber>(b).mValue, std::get<lua::LuaNumber>(a).mValue);
@@ -149,9 +547,168 @@ inline int lua_setFontOutline(lua_State* L)
     lua::LuaEngine lua;
     lua.mL = L;
     lua::LuaValue outlineSize = lua.popValue();
-    TTF_Font* font = (TTF_Font*)lua_touserdata(L, -1);
+    TTF_Font* font = toFont(L, -1);
+    if (!font)
+    {
+        return 0;
+    }
     setFontOutline(font, std::get<lua::LuaNumber>(outlineSize).mValue);
     return 0;
 }
 
+// measureText(font, text [, wrapWidth]) returns width, height
+inline int lua_measureText(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    int wrapWidth = 0;
+    if (lua_gettop(L) >= 3)
+    {
+        wrapWidth = std::get<lua::LuaNumber>(lua.popValue()).mValue;
+    }
+    lua::LuaValue text = lua.popValue();
+    TTF_Font* font = toFont(L, -1);
+    if (!font)
+    {
+        return 0;
+    }
+    int width, height;
+    measureText(font, lua::getLuaValueString(text), wrapWidth, width, height);
+    lua.pushValue(lua::LuaNumber::make(width));
+    lua.pushValue(lua::LuaNumber::make(height));
+    return 2;
+}
+
+// createText(font, text [, wrapWidth])
+inline int lua_createText(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    int wrapWidth = 0;
+    if (lua_gettop(L) >= 3)
+    {
+        wrapWidth = std::get<lua::LuaNumber>(lua.popValue()).mValue;
+    }
+    lua::LuaValue text = lua.popValue();
+    TTF_Font* font = toFont(L, -1);
+    if (!font)
+    {
+        return 0;
+    }
+    TextObject* obj = createText(font, lua::getLuaValueString(text), wrapWidth);
+    pushText(L, obj);
+    return 1;
+}
+
+// updateText(obj, text [, wrapWidth]), the layout is only redone when something changed
+inline int lua_updateText(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    int wrapWidth = 0;
+    if (lua_gettop(L) >= 3)
+    {
+        wrapWidth = std::get<lua::LuaNumber>(lua.popValue()).mValue;
+    }
+    lua::LuaValue text = lua.popValue();
+    TextObject* obj = toText(L, -1);
+    if (!obj)
+    {
+        return 0;
+    }
+    updateText(obj, lua::getLuaValueString(text), wrapWidth);
+    return 0;
+}
+
+inline int lua_drawTextObject(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue a = lua.popValue();
+    lua::LuaValue b = lua.popValue();
+    lua::LuaValue g = lua.popValue();
+    lua::LuaValue r = lua.popValue();
+    lua::LuaValue y = lua.popValue();
+    lua::LuaValue x = lua.popValue();
+    TextObject* obj = toText(L, -1);
+    if (!obj)
+    {
+        return 0;
+    }
+    drawTextObject(obj, std::get<lua::LuaNumber>(x).mValue, std::get<lua::LuaNumber>(y).mValue,
+                   std::get<lua::LuaNumber>(r).mValue, std::get<lua::LuaNumber>(g).mValue, std::get<lua::LuaNumber>(b).mValue, std::get<lua::LuaNumber>(a).mValue);
+    return 0;
+}
+
+inline int lua_getTextObjectWidth(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    TextObject* obj = toText(L, -1);
+    if (!obj)
+    {
+        return 0;
+    }
+    lua.pushValue(lua::LuaNumber::make(getTextObjectWidth(obj)));
+    return 1;
+}
+
+inline int lua_getTextObjectHeight(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    TextObject* obj = toText(L, -1);
+    if (!obj)
+    {
+        return 0;
+    }
+    lua.pushValue(lua::LuaNumber::make(getTextObjectHeight(obj)));
+    return 1;
+}
+
+inline int lua_destroyText(lua_State* L)
+{
+    TextObject* obj = toText(L, -1);
+    if (!obj)
+    {
+        return 0;
+    }
+    destroyText(obj);
+    return 0;
+}
+
+inline int lua_getRenderStats(lua_State* L)
+{
+    RenderStats stats = getRenderStats();
+    lua_newtable(L);
+    lua_pushnumber(L, stats.mDrawCalls);
+    lua_setfield(L, -2, "drawCalls");
+    lua_pushnumber(L, stats.mQuads);
+    lua_setfield(L, -2, "quads");
+    lua_pushnumber(L, stats.mMaxBatchQuads);
+    lua_setfield(L, -2, "maxBatchQuads");
+    lua_pushnumber(L, stats.mDrawCalls ? double(stats.mQuads) / stats.mDrawCalls : 0.0);
+    lua_setfield(L, -2, "averageBatchQuads");
+    return 1;
+}
+
+inline int lua_setInstancedSprites(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue enabled = lua.popValue();
+    setInstancedSprites(std::get<lua::LuaBoolean>(enabled).mValue);
+    return 0;
+}
+
+inline int lua_setLayerReorder(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue enabled = lua.popValue();
+    lua::LuaValue layer = lua.popValue();
+    setLayerReorder(std::get<lua::LuaNumber>(layer).mValue, std::get<lua::LuaBoolean>(enabled).mValue);
+    return 0;
+}
+
 } // namespace gegege::otsukimi
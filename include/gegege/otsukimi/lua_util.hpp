@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../lua_engine/lua_engine.hpp"
+#include "renderer.hpp"
 #include "util.hpp"
 
 namespace gegege::otsukimi {
@@ -27,4 +28,114 @@ inline int lua_getMouseCoordinateToScreenCoordinateY(lua_State* L)
     return 1;
 }
 
+inline int lua_setTickRate(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue ticksPerSecond = lua.popValue();
+
+    setTickRate(std::get<lua::LuaNumber>(ticksPerSecond).mValue);
+
+    return 0;
+}
+
+inline int lua_setMaxCatchUpTicks(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue ticks = lua.popValue();
+
+    setMaxCatchUpTicks(std::get<lua::LuaNumber>(ticks).mValue);
+
+    return 0;
+}
+
+inline int lua_getInterpolationAlpha(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+
+    lua.pushValue(lua::LuaNumber::make(getInterpolationAlpha()));
+
+    return 1;
+}
+
+// setPacingMode("vsync", "adaptive", "uncapped" or "limited")
+inline int lua_setPacingMode(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    std::string name = lua::getLuaValueString(lua.popValue());
+
+    if (name == "vsync")
+    {
+        setPacingMode(PacingMode::VSync);
+    }
+    else if (name == "adaptive")
+    {
+        setPacingMode(PacingMode::Adaptive);
+    }
+    else if (name == "uncapped")
+    {
+        setPacingMode(PacingMode::Uncapped);
+    }
+    else if (name == "limited")
+    {
+        setPacingMode(PacingMode::Limited);
+    }
+    else
+    {
+        SDL_Log("setPacingMode: unknown mode %s", name.c_str());
+    }
+
+    return 0;
+}
+
+inline int lua_setFrameRateLimit(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue fps = lua.popValue();
+
+    setFrameRateLimit(std::get<lua::LuaNumber>(fps).mValue);
+
+    return 0;
+}
+
+inline int lua_setMaxQueuedFrames(lua_State* L)
+{
+    lua::LuaEngine lua;
+    lua.mL = L;
+    lua::LuaValue frames = lua.popValue();
+
+    double value = std::get<lua::LuaNumber>(frames).mValue;
+    if (!(value >= 0.0))
+    {
+        SDL_Log("setMaxQueuedFrames: expected a non-negative number");
+        return 0;
+    }
+
+    // more queued frames than the renderer keeps in flight never blocks
+    setMaxQueuedFrames(static_cast<unsigned int>(std::min(value, double(FRAME_OVERLAP))));
+
+    return 0;
+}
+
+inline int lua_getPacingStats(lua_State* L)
+{
+    PacingStats stats = getPacingStats();
+    lua_newtable(L);
+    lua_pushnumber(L, stats.mSamples);
+    lua_setfield(L, -2, "samples");
+    lua_pushnumber(L, stats.mMeanMS);
+    lua_setfield(L, -2, "meanMS");
+    lua_pushnumber(L, stats.mMinMS);
+    lua_setfield(L, -2, "minMS");
+    lua_pushnumber(L, stats.mMaxMS);
+    lua_setfield(L, -2, "maxMS");
+    lua_pushnumber(L, stats.mJitterMS);
+    lua_setfield(L, -2, "jitterMS");
+    return 1;
+}
+
 } // namespace gegege::otsukimi
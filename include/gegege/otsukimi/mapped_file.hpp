@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace gegege::otsukimi {
+
+// Read-only memory mapping of a whole file.
+// The platform handles are kept opaque so that windows.h stays out of the headers.
+struct MappedFile {
+    const unsigned char* mData = nullptr;
+    size_t mSize = 0;
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+};
+
+bool mapFile(const std::filesystem::path& path, MappedFile& file);
+
+void unmapFile(MappedFile& file);
+
+} // namespace gegege::otsukimi
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../lua_engine/lua_engine.hpp"
+#include "fixed_timestep.hpp"
+#include "frame_pacer.hpp"
 #include "gl.h"
 #include "renderer.hpp"
 #include "graphics.hpp"
@@ -13,6 +15,9 @@ namespace gegege::otsukimi {
 
 extern Renderer* gRenderer;
 
+struct Otsukimi;
+extern Otsukimi* gOtsukimi;
+
 struct Otsukimi {
     SDL_Window* mSdlWindow;
     SDL_GLContext mGlContext;
@@ -20,6 +25,9 @@ struct Otsukimi {
     uint64_t mPrevTime;
     Renderer mRenderer;
     bool mFullscreen;
+    // onFixedUpdate runs from this, off unless a tick rate is set
+    FixedTimestep mFixedTimestep;
+    FramePacer mFramePacer;
 
     virtual void startup();
 
@@ -55,6 +63,11 @@ struct Otsukimi {
     {
     }
 
+    // called zero or more times before each onUpdate, dt is always the tick length
+    virtual void onFixedUpdate(float dt)
+    {
+    }
+
     virtual void onUpdate(float dt)
     {
     }
@@ -7,9 +7,24 @@
 #include <glm/ext/matrix_clip_space.hpp>
 
 #include "gl.h"
-
+#include "asset_pack.hpp"
+#include "atlas.hpp"
+#include "draw_queue.hpp"
+#include "handle_pool.hpp"
+#include "sprite_kernel.hpp"
+#include "texture_cache.hpp"
+#include "texture_loader.hpp"
+#include "texture_uploader.hpp"
+#include "transient_texture_pool.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 #include <vector>
 
@@ -17,18 +32,68 @@
 
 namespace gegege::otsukimi {
 
-constexpr unsigned int FRAME_OVERLAP = 1;
-constexpr unsigned int MAX_VERTEX = 1024;
-
+#ifndef OTSUKIMI_FRAME_OVERLAP
+#define OTSUKIMI_FRAME_OVERLAP 2
+#endif
+
+// number of frames the CPU may record while the GPU still consumes earlier ones
+constexpr unsigned int FRAME_OVERLAP = OTSUKIMI_FRAME_OVERLAP;
+// initial size of each frame's region of the vertex ring buffer, regions grow to the high-water mark
+constexpr GLsizeiptr STREAM_REGION_BYTES = 2 * 1024 * 1024;
+// 16-bit indices address 65536 vertices, longer batches are split and drawn with a base vertex
+constexpr unsigned int MAX_QUADS_PER_DRAW = 65536 / 4;
+// atlas group shared by the glyphs of every font, so all text can land in one batch
+constexpr const char* GLYPH_ATLAS_GROUP = "#glyphs";
+// texture units one batch may sample from, the sprite shader selects the unit per vertex
+constexpr unsigned int MAX_TEXTURE_SLOTS = 8;
+
+// 24 bytes, color is normalized RGBA8.
+// UVs stay float because repeating source rects address beyond [0, 1].
 struct Vertex {
     float mX;
     float mY;
     float mU;
     float mV;
-    float mR;
-    float mG;
-    float mB;
-    float mA;
+    uint8_t mR;
+    uint8_t mG;
+    uint8_t mB;
+    uint8_t mA;
+    uint8_t mSlot;
+    uint8_t mPadding[3];
+};
+
+// Vertex colors are stored as 8-bit unorm, so tints outside 0 to 1 cannot be represented.
+// They are clamped, overbright tints above 1 draw like 1 and NaN draws like 0, the first one is logged.
+inline uint8_t toUnorm8(float value)
+{
+    // written so NaN, which fails every comparison, also takes this branch
+    if (!(value >= 0.0f && value <= 1.0f))
+    {
+        static bool warned = false;
+        if (!warned)
+        {
+            SDL_Log("drawTexture: color %g is clamped to [0, 1], overbright tints are not supported", value);
+            warned = true;
+        }
+        value = value > 1.0f ? 1.0f : 0.0f;
+    }
+    return uint8_t(value * 255.0f + 0.5f);
+}
+
+// one sprite of the instanced path, expanded to a quad in the vertex shader
+struct SpriteInstance {
+    float mX;
+    float mY;
+    float mWidth;
+    float mHeight;
+    float mAngle;
+    float mU0;
+    float mV0;
+    float mU1;
+    float mV1;
+    uint8_t mColor[4];
+    uint8_t mSlot;
+    uint8_t mPadding[3];
 };
 
 struct Texture {
@@ -36,6 +101,63 @@ struct Texture {
     GLuint mFramebufferID;
     int mWidth;
     int mHeight;
+    // sub-rectangle inside the GL texture, the whole texture unless packed into an atlas page
+    int mAtlasX;
+    int mAtlasY;
+    int mPageWidth;
+    int mPageHeight;
+    // requested with textureFindAsync and still showing the placeholder
+    bool mPending;
+    // sampler state set by setTextureFilter, GL_NEAREST without mipmaps by default
+    bool mLinearFilter;
+    bool mMipmapped;
+    // GL storage this Texture owns, 0 for atlas entries, placeholders and evicted textures
+    size_t mBytes;
+    uint32_t mLastUsedFrame;
+    // storage was freed to stay within the texture budget, the next draw reloads it
+    bool mEvicted;
+};
+
+// drivers pad RGB8 to four bytes per texel, so every texel is counted as four
+inline size_t textureBytes(int width, int height, bool mipmapped)
+{
+    size_t bytes = size_t(width) * height * 4;
+    return mipmapped ? bytes + bytes / 3 : bytes;
+}
+
+struct Glyph {
+    // nullptr for glyphs without pixels
+    Texture* mTexture;
+    // horizontal offset of the rendered glyph from the pen position
+    int mOffsetX;
+    int mAdvance;
+};
+
+// a glyph placed by layoutText, relative to the top-left of the text block with y growing downwards
+struct PlacedGlyph {
+    const Glyph* mGlyph;
+    float mX;
+    float mY;
+};
+
+// retained text, laid out again only when its string, wrap width or the font outline changes
+struct TextObject {
+    TTF_Font* mFont;
+    std::string mText;
+    int mWrapWidth;
+    int mOutline;
+    int mWidth;
+    int mHeight;
+    std::vector<PlacedGlyph> mGlyphs;
+};
+
+struct AtlasPage {
+    Texture* mTexture;
+    SkylinePacker mPacker;
+};
+
+struct AtlasGroup {
+    std::vector<AtlasPage> mPages;
 };
 
 struct VBO {
@@ -43,31 +165,181 @@ struct VBO {
     GLsizeiptr mNumBytes;
 };
 
+struct RenderStats {
+    uint32_t mDrawCalls;
+    uint32_t mQuads;
+    uint32_t mMaxBatchQuads;
+};
+
+// hits and misses count textureFind and textureFindAsync lookups, all counters run for the whole session
+struct TextureStats {
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mEvictions;
+    uint32_t mReloads;
+    size_t mResidentBytes;
+    size_t mBudgetBytes;
+};
+
 struct FrameData {
-    VBO* mVertexBuffer;
-    std::vector<Texture*> mTextTextures;
-    std::vector<Texture*> mTextures;
+    // signalled once the GPU is done with everything this frame submitted
+    GLsync mFence = nullptr;
+    // write cursor, in bytes, inside this frame's region of the vertex ring buffer
+    GLsizeiptr mStreamCursor = 0;
+    // draw commands queued since the last flush, mSortKeys[i] low bits index into mCommands
+    std::vector<SpriteDesc> mCommands;
+    std::vector<uint64_t> mSortKeys;
+    std::vector<uint64_t> mSortScratch;
+    std::vector<SpriteDesc> mSortedCommands;
+    // sort key texture field of each GL texture drawn in a reordering layer this frame, numbered in order of first use
+    std::unordered_map<GLuint, uint32_t> mSortTextures;
+    // textures bound to units 0..mSlotCount-1 when the batch is flushed
+    GLuint mSlotTextures[MAX_TEXTURE_SLOTS];
+    unsigned int mSlotCount = 0;
+    size_t mQuadCount = 0;
     std::vector<Vertex> mVertices;
+    std::vector<SpriteInstance> mInstances;
     Texture* mFrameBuffer;
 };
 
 struct Renderer {
     GLuint mVAO;
+    VBO* mVertexBuffer;
+    GLuint mIndexBufferID;
     GLuint mShader;
     GLint mMVPLocation;
 
+    // instanced path: one SpriteInstance per sprite, transformed on the GPU
+    GLuint mInstanceVAO;
+    GLuint mInstanceShader;
+    GLint mInstanceMVPLocation;
+    bool mInstancedSprites = false;
+
+    // units in use per batch, 1 gives the classic one-texture-per-draw batching
+    unsigned int mTextureSlots = MAX_TEXTURE_SLOTS;
+
+    glm::mat4 mProjection;
+
     FrameData mFrames[FRAME_OVERLAP];
-    uint32_t mFrameNumber;
+    uint32_t mFrameNumber = 0;
     FrameData& getCurrentFrame() { return mFrames[mFrameNumber % FRAME_OVERLAP]; }
 
+    // Vertices are written with unsynchronized maps into the frame's own ring region,
+    // the region's fence guarantees the GPU is done reading it before the frame is recorded again.
+    // When disabled, glBufferSubData is used and the driver synchronizes implicitly.
+    bool mStreamingVertexBuffer = true;
+    GLsizeiptr mStreamRegionBytes = STREAM_REGION_BYTES;
+    // most bytes any frame has streamed so far, the regions are grown to cover it
+    GLsizeiptr mStreamHighWater = 0;
+
+    // sprites per batch, the whole frame is queued and sorted before it is split into batches
+    size_t mMaxBatchQuads = 65536;
+
+    // Batching settings changed by scripts take effect at the next frame's flush,
+    // so a frame is never cut into separately sorted parts.
+    bool mNextInstancedSprites = false;
+    unsigned int mNextTextureSlots = MAX_TEXTURE_SLOTS;
+    size_t mNextMaxBatchQuads = 65536;
+
+    // layers whose sprites may be grouped by texture, indexed by layer + 32768
+    std::bitset<65536> mReorderLayers;
+
+    // mStats is accumulated while the frame is recorded, mLastStats holds the last completed frame
+    RenderStats mStats = {};
+    RenderStats mLastStats = {};
+
+    // Textures and text objects live in pools so scripts can refer to them by handle.
+    HandlePool<Texture> mTexturePool;
+    HandlePool<TextObject> mTextPool;
+    // fonts are owned by SDL_ttf, their pool only hands out handles
+    HandlePool<TTF_Font*> mFontPool;
+    std::unordered_map<TTF_Font*, Handle> mFontHandles;
+
+    // References taken with retainTexture and retainFont, by scripts and text objects.
+    // Whatever is released down to 0 is unloaded at the start of the next frame, once its draws are flushed.
+    std::unordered_map<Texture*, int> mTextureRefs;
+    std::unordered_map<TTF_Font*, int> mFontRefs;
+    std::vector<Texture*> mUnusedTextures;
+    std::vector<TTF_Font*> mUnusedFonts;
+    // Objects C++ code looked up. No reference tracks the raw pointers it keeps, so these stay loaded until shutdown.
+    std::unordered_set<Texture*> mPinnedTextures;
+    std::unordered_set<TTF_Font*> mPinnedFonts;
+
     std::unordered_map<std::string, Texture*> mTextures;
+
+    // Decoded images are cooked into the user's pref directory and mapped from there on later runs.
+    // Empty when the pref directory is unavailable, which disables the cache.
+    bool mTextureCacheEnabled = true;
+    std::filesystem::path mTextureCachePath;
+
+    // textureFindAsync hands out textures showing this 1x1 transparent image until the decode is uploaded
+    Texture* mPlaceholderTexture;
+    TextureLoader mTextureLoader;
+    // all texel uploads after creation go through pixel buffers
+    TextureUploader mTextureUploader;
+    // storage of deleted standalone textures, reused by createTexture
+    TransientTexturePool mTransientTextures;
+    // bytes of decoded pixels uploaded per frame, at least one image is uploaded regardless
+    size_t mTextureUploadBudget = 4 * 1024 * 1024;
+    // images loaded into textures of their own get a mip chain right away
+    bool mTextureMipmapsOnLoad = false;
+
+    // bytes of every GL texture the renderer created
+    size_t mTextureBytes = 0;
+    // Once mTextureBytes exceeds the budget, textures loaded from a path are evicted, least recently drawn first.
+    // 0 disables eviction.
+    size_t mTextureBudget = 0;
+    TextureStats mTextureStats = {};
+    // paths of evicted textures, for reloading them on their next draw
+    std::unordered_map<Texture*, std::string> mEvictedPaths;
     std::unordered_map<std::string, TTF_Font*> mFonts;
+    // rasterized glyphs per font, keyed by outline << 32 | codepoint
+    std::unordered_map<TTF_Font*, std::unordered_map<uint64_t, Glyph>> mGlyphs;
+    // Atlas glyphs of unloaded fonts, keyed like mFonts. Glyph atlas space is not reclaimed,
+    // so a font loaded again takes its glyphs back instead of rasterizing them into new space.
+    std::unordered_map<std::string, std::unordered_map<uint64_t, Glyph>> mUnloadedGlyphs;
+    std::vector<PlacedGlyph> mPlacedGlyphs;
+    std::vector<SpriteDesc> mTextSprites;
+
+    // atlas mode packs small images into shared pages so they can share a batch
+    bool mAtlasEnabled = false;
+    int mAtlasPageSize = 2048;
+    int mAtlasMaxEntrySize = 256;
+    std::unordered_map<std::string, AtlasGroup> mAtlasGroups;
+    std::unordered_map<std::string, std::string> mAtlasGroupOfPath;
 
     int mTargetOffscreenWidth;
     int mTargetOffscreenHeight;
     int mScreenWidth;
     int mScreenHeight;
     bool isDirtyOffscreenSize = false;
+    // Frames are drawn straight into the window when the offscreen size matches it, or always when this is set,
+    // in which case the viewport does the scaling. Otherwise they go through the offscreen buffer.
+    bool mDirectRendering = false;
+    // the frame being recorded draws into the window
+    bool mRenderingDirect = false;
+
+    // Redraw on demand: a frame that draws exactly what the last presented one drew is not presented,
+    // and the main loop sleeps until input arrives or the minimum frame rate is due.
+    bool mRedrawOnDemand = false;
+    // 0 sleeps until input
+    float mMinFrameRate = 0.0f;
+    // presents the next frame even when it is unchanged, for changes the draw commands do not show
+    bool mRedrawRequested = true;
+    uint64_t mFrameHash = FRAME_HASH_SEED;
+    uint64_t mPresentedFrameHash = 0;
+    // set by skipUnchangedFrame, the frame just finished was dropped without being rendered
+    bool mFrameUnchanged = false;
+    // part of the frame was already rendered because the queue filled up, so it can no longer be dropped
+    bool mFlushedMidFrame = false;
+    // the window viewport of the frame, its render target is bound on first use
+    GLint mViewportX = 0;
+    GLint mViewportY = 0;
+    GLsizei mViewportWidth = 0;
+    GLsizei mViewportHeight = 0;
+    bool mTargetBound = false;
+    // textures requested with textureFindAsync and not uploaded yet
+    size_t mPendingTextureCount = 0;
 
     SDL_Window* mSdlWindow;
 
@@ -81,45 +353,185 @@ struct Renderer {
         glGenVertexArrays(1, &mVAO);
         glBindVertexArray(mVAO);
 
+        std::string fragmentShader = createSpriteFragmentShader();
+
         mShader = createShader(
             R"(#version 330
 layout(location = 0)in vec2 vPosition;
 layout(location = 1)in vec2 vTexCoord;
 layout(location = 2)in vec4 vColor;
+layout(location = 3)in uint vSlot;
 uniform mat4 uMVP;
 out vec2 pTexCoord;
 out vec4 pColor;
+flat out uint pSlot;
 void main()
 {
     gl_Position = uMVP * vec4(vPosition.x, vPosition.y, 0.0, 1.0);
     pTexCoord = vTexCoord;
     pColor = vColor;
+    pSlot = vSlot;
 }
 )",
+            fragmentShader.c_str());
+        glUseProgram(mShader);
+
+        mMVPLocation = glGetUniformLocation(mShader, "uMVP");
+
+        mIndexBufferID = createQuadIndexBuffer();
+        mVertexBuffer = createVBO(mStreamRegionBytes * FRAME_OVERLAP);
+
+        // corners come from gl_VertexID in triangle strip order: top-left, bottom-left, top-right, bottom-right
+        mInstanceShader = createShader(
             R"(#version 330
-in vec2 pTexCoord;
-in vec4 pColor;
-uniform sampler2D uTex;
-out vec4 fragColor;
+layout(location = 0)in vec2 iPosition;
+layout(location = 1)in vec2 iSize;
+layout(location = 2)in float iAngle;
+layout(location = 3)in vec4 iTexRect;
+layout(location = 4)in vec4 iColor;
+layout(location = 5)in uint iSlot;
+uniform mat4 uMVP;
+out vec2 pTexCoord;
+out vec4 pColor;
+flat out uint pSlot;
 void main()
 {
-    fragColor = texture(uTex, pTexCoord) * pColor;
-})");
+    vec2 corner = vec2(float(gl_VertexID >> 1), float(gl_VertexID & 1));
+    vec2 local = vec2(corner.x - 0.5, 0.5 - corner.y) * iSize;
+    float c = cos(iAngle);
+    float s = sin(iAngle);
+    vec2 world = vec2(c * local.x - s * local.y, s * local.x + c * local.y) + iPosition;
+    gl_Position = uMVP * vec4(world, 0.0, 1.0);
+    pTexCoord = mix(iTexRect.xy, iTexRect.zw, corner);
+    pColor = iColor;
+    pSlot = iSlot;
+}
+)",
+            fragmentShader.c_str());
+        mInstanceMVPLocation = glGetUniformLocation(mInstanceShader, "uMVP");
+
+        GLint units[MAX_TEXTURE_SLOTS];
+        for (unsigned int i = 0; i < MAX_TEXTURE_SLOTS; ++i)
+        {
+            units[i] = i;
+        }
+        glUseProgram(mInstanceShader);
+        glUniform1iv(glGetUniformLocation(mInstanceShader, "uTex"), MAX_TEXTURE_SLOTS, units);
         glUseProgram(mShader);
+        glUniform1iv(glGetUniformLocation(mShader, "uTex"), MAX_TEXTURE_SLOTS, units);
 
-        mMVPLocation = glGetUniformLocation(mShader, "uMVP");
+        GLint maxTextureUnits;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxTextureUnits);
+        mTextureSlots = std::min(mTextureSlots, (unsigned int)maxTextureUnits);
+        mNextTextureSlots = mTextureSlots;
+
+        glGenVertexArrays(1, &mInstanceVAO);
+        glBindVertexArray(mInstanceVAO);
+        for (GLuint i = 0; i < 6; ++i)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        glBindVertexArray(mVAO);
 
         for (auto& i : mFrames)
         {
-            i.mVertexBuffer = createVBO(sizeof(Vertex) * MAX_VERTEX);
             i.mFrameBuffer = createFBO(mTargetOffscreenWidth, mTargetOffscreenHeight);
         }
 
         glActiveTexture(GL_TEXTURE0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        GLint maxTextureSize;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        mAtlasPageSize = std::min(mAtlasPageSize, int(maxTextureSize));
+
+        char* prefPath = SDL_GetPrefPath("gegege", "otsukimi");
+        if (prefPath)
+        {
+            mTextureCachePath = prefPath;
+            mTextureCachePath.append("texture_cache");
+            SDL_free(prefPath);
+        }
+
+        const unsigned char transparent[4] = {0, 0, 0, 0};
+        mPlaceholderTexture = createTexture(transparent, 1, 1, 4);
     }
 
     void shutdown()
     {
+        if (mTextureLoader.isRunning())
+        {
+            mTextureLoader.shutdown();
+        }
+        mTextureUploader.shutdown();
+
+        for (auto& [path, tex] : mTextures)
+        {
+            deleteTexture(tex);
+        }
+        mTextures.clear();
+        mEvictedPaths.clear();
+        mTextureRefs.clear();
+        mUnusedTextures.clear();
+        mPinnedTextures.clear();
+
+        for (auto& [font, glyphs] : mGlyphs)
+        {
+            deleteGlyphs(glyphs);
+        }
+        mGlyphs.clear();
+        for (auto& [key, glyphs] : mUnloadedGlyphs)
+        {
+            deleteGlyphs(glyphs);
+        }
+        mUnloadedGlyphs.clear();
+
+        for (auto& [name, group] : mAtlasGroups)
+        {
+            for (AtlasPage& page : group.mPages)
+            {
+                deleteTexture(page.mTexture);
+            }
+        }
+        mAtlasGroups.clear();
+
+        for (auto& [key, font] : mFonts)
+        {
+            if (font)
+            {
+                mFontPool.release(mFontPool.get(mFontHandles[font]));
+                TTF_CloseFont(font);
+            }
+        }
+        mFonts.clear();
+        mFontHandles.clear();
+        mFontRefs.clear();
+        mUnusedFonts.clear();
+        mPinnedFonts.clear();
+
+        deleteTexture(mPlaceholderTexture);
+
+        for (FrameData& frame : mFrames)
+        {
+            if (frame.mFence)
+            {
+                glDeleteSync(frame.mFence);
+                frame.mFence = nullptr;
+            }
+            deleteTexture(frame.mFrameBuffer);
+        }
+
+        mTransientTextures.shutdown();
+
+        glDeleteBuffers(1, &mVertexBuffer->mVertexBufferID);
+        delete mVertexBuffer;
+        glDeleteBuffers(1, &mIndexBufferID);
+        glDeleteVertexArrays(1, &mVAO);
+        glDeleteVertexArrays(1, &mInstanceVAO);
+        glDeleteProgram(mShader);
+        glDeleteProgram(mInstanceShader);
+
         TTF_Quit();
     }
 
@@ -145,65 +557,240 @@ void main()
     {
         mFrameNumber++;
 
+        mLastStats = mStats;
+        mStats = {};
+
+        processTextureUploads();
+        unloadUnusedResources();
+        enforceTextureBudget();
+
         FrameData& frame = getCurrentFrame();
-        for (Texture* tex : frame.mTextTextures)
+        if (frame.mFence)
+        {
+            while (glClientWaitSync(frame.mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+            glDeleteSync(frame.mFence);
+            frame.mFence = nullptr;
+        }
+        frame.mStreamCursor = 0;
+
+        mTransientTextures.update(mFrameNumber);
+
+        if (mStreamHighWater > mStreamRegionBytes)
         {
-            glDeleteTextures(1, &tex->mTexID);
-            delete tex;
+            growStreamRegions(mStreamHighWater);
         }
-        frame.mTextTextures.clear();
-        frame.mTextures.clear();
+
+        frame.mCommands.clear();
+        frame.mSortKeys.clear();
+        frame.mSortTextures.clear();
+        frame.mSlotCount = 0;
+        frame.mQuadCount = 0;
         frame.mVertices.clear();
+        frame.mInstances.clear();
+        mFlushedMidFrame = false;
+
+        mInstancedSprites = mNextInstancedSprites;
+        mTextureSlots = mNextTextureSlots;
+        mMaxBatchQuads = mNextMaxBatchQuads;
 
         if (isDirtyOffscreenSize)
         {
             for (FrameData& frame : mFrames)
             {
-                glDeleteTextures(1, &frame.mFrameBuffer->mTexID);
-                glDeleteFramebuffers(1, &frame.mFrameBuffer->mFramebufferID);
-                delete frame.mFrameBuffer;
+                deleteTexture(frame.mFrameBuffer);
                 frame.mFrameBuffer = createFBO(mTargetOffscreenWidth, mTargetOffscreenHeight);
             }
             isDirtyOffscreenSize = false;
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, frame.mFrameBuffer->mFramebufferID);
+        mRenderingDirect = mDirectRendering || (viewportWidth == mTargetOffscreenWidth && viewportHeight == mTargetOffscreenHeight);
+        if (mRedrawOnDemand)
+        {
+            int frameState[5] = {viewportWidth, viewportHeight, mTargetOffscreenWidth, mTargetOffscreenHeight, mRenderingDirect};
+            mFrameHash = hashWords(FRAME_HASH_SEED, frameState, 5);
+        }
+
+        mProjection = glm::ortho(float(-mTargetOffscreenWidth) / 2.0f, float(mTargetOffscreenWidth) / 2.0f, float(-mTargetOffscreenHeight) / 2.0f, float(mTargetOffscreenHeight) / 2.0f);
+
+        mScreenWidth = viewportWidth;
+        mScreenHeight = viewportHeight;
+        mViewportX = viewportX;
+        mViewportY = viewportY;
+        mViewportWidth = viewportWidth;
+        mViewportHeight = viewportHeight;
+        mTargetBound = false;
+    }
+
+    // Binds and clears the frame's render target, called by the first flush or postUpdate of the frame,
+    // so a frame dropped by skipUnchangedFrame leaves the GPU alone.
+    void bindRenderTarget()
+    {
+        if (mTargetBound)
+        {
+            return;
+        }
+        mTargetBound = true;
+
+        if (mRenderingDirect)
+        {
+            GLint x, y;
+            GLsizei width, height;
+            getLetterbox(mViewportX, mViewportY, mViewportWidth, mViewportHeight, x, y, width, height);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (width != mViewportWidth || height != mViewportHeight)
+            {
+                glViewport(mViewportX, mViewportY, mViewportWidth, mViewportHeight);
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+
+            glViewport(x, y, width, height);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(x, y, width, height);
+            glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, getCurrentFrame().mFrameBuffer->mFramebufferID);
 
-        glViewport(0, 0, mTargetOffscreenWidth, mTargetOffscreenHeight);
-        glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+            glViewport(0, 0, mTargetOffscreenWidth, mTargetOffscreenHeight);
+            glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
 
         glEnable(GL_BLEND);
         glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
         glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+    }
 
-        glm::mat4 ortho = glm::ortho(float(-mTargetOffscreenWidth) / 2.0f, float(mTargetOffscreenWidth) / 2.0f, float(-mTargetOffscreenHeight) / 2.0f, float(mTargetOffscreenHeight) / 2.0f);
+    // Called once everything is queued, before the last flush. A frame that would draw exactly what the last
+    // presented one drew has its commands discarded and the caller skips flush, postUpdate, endFrame and the swap.
+    bool skipUnchangedFrame()
+    {
+        // frames keep being presented while async textures are still replacing their placeholders
+        mFrameUnchanged = mRedrawOnDemand && !mRedrawRequested && !mFlushedMidFrame && mPendingTextureCount == 0 && mFrameHash == mPresentedFrameHash;
+        mRedrawRequested = false;
+        if (!mFrameUnchanged)
+        {
+            mPresentedFrameHash = mFrameHash;
+            return false;
+        }
 
-        glUniformMatrix4fv(mMVPLocation, 1, GL_FALSE, glm::value_ptr(ortho));
+        FrameData& frame = getCurrentFrame();
+        frame.mCommands.clear();
+        frame.mSortKeys.clear();
+        return true;
+    }
 
-        mScreenWidth = viewportWidth;
-        mScreenHeight = viewportHeight;
+    // called after the last flush of the frame
+    void endFrame()
+    {
+        FrameData& frame = getCurrentFrame();
+        mStreamHighWater = std::max(mStreamHighWater, frame.mStreamCursor);
+        frame.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void setRedrawOnDemand(bool enabled)
+    {
+        mRedrawOnDemand = enabled;
+        mRedrawRequested = true;
+    }
+
+    void setMinFrameRate(float fps)
+    {
+        mMinFrameRate = fps;
     }
 
+    void requestRedraw()
+    {
+        mRedrawRequested = true;
+    }
+
+    // how long the main loop may sleep after an unchanged frame, -1 waits for input
+    Sint32 getIdleTimeoutMS()
+    {
+        return mMinFrameRate > 0.0f ? Sint32(std::ceil(1000.0f / mMinFrameRate)) : -1;
+    }
+
+    // Copies the offscreen buffer into the window, scaled to fit and centered between black bars.
+    // Nothing to do when the frame was drawn into the window directly.
     void postUpdate(GLint viewportX, GLint viewportY, GLsizei viewportWidth, GLsizei viewportHeight)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        bindRenderTarget();
+        if (mRenderingDirect)
+        {
+            return;
+        }
 
-        glViewport(viewportX, viewportY, viewportWidth, viewportHeight);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        GLint x, y;
+        GLsizei width, height;
+        getLetterbox(viewportX, viewportY, viewportWidth, viewportHeight, x, y, width, height);
 
-        glEnable(GL_BLEND);
-        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-        glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+        FrameData& frame = getCurrentFrame();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, frame.mFrameBuffer->mFramebufferID);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+        if (width != viewportWidth || height != viewportHeight)
+        {
+            glViewport(viewportX, viewportY, viewportWidth, viewportHeight);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
 
-        glm::mat4 ortho = glm::ortho(float(-viewportWidth) / 2.0f, float(viewportWidth) / 2.0f, float(-viewportHeight) / 2.0f, float(viewportHeight) / 2.0f);
+        // the offscreen texture is sampled with GL_NEAREST, the blit filters the same way
+        glBlitFramebuffer(0, 0, frame.mFrameBuffer->mWidth, frame.mFrameBuffer->mHeight, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 
-        glUniformMatrix4fv(mMVPLocation, 1, GL_FALSE, glm::value_ptr(ortho));
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
+    // the largest rectangle of the offscreen aspect ratio centered in the viewport
+    void getLetterbox(GLint viewportX, GLint viewportY, GLsizei viewportWidth, GLsizei viewportHeight, GLint& outX, GLint& outY, GLsizei& outWidth, GLsizei& outHeight)
+    {
         float scale = std::min(float(viewportWidth) / mTargetOffscreenWidth, float(viewportHeight) / mTargetOffscreenHeight);
-        FrameData& frame = getCurrentFrame();
-        drawTexture(frame.mFrameBuffer, 0, 0, frame.mFrameBuffer->mWidth, frame.mFrameBuffer->mHeight, scale, -scale, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+        outWidth = GLsizei(std::lround(mTargetOffscreenWidth * scale));
+        outHeight = GLsizei(std::lround(mTargetOffscreenHeight * scale));
+        outX = viewportX + (viewportWidth - outWidth) / 2;
+        outY = viewportY + (viewportHeight - outHeight) / 2;
+    }
+
+    void setDirectRendering(bool enabled)
+    {
+        mDirectRendering = enabled;
+    }
+
+    // GLSL 3.30 only allows constant indices into sampler arrays, so the slot picks the sampler through a switch.
+    // Gradients are taken before branching, texture() inside the non-uniform branches would have undefined derivatives.
+    std::string createSpriteFragmentShader()
+    {
+        std::string source = R"(#version 330
+in vec2 pTexCoord;
+in vec4 pColor;
+flat in uint pSlot;
+)";
+        source += "uniform sampler2D uTex[" + std::to_string(MAX_TEXTURE_SLOTS) + "];\n";
+        source += R"(out vec4 fragColor;
+void main()
+{
+    vec2 dx = dFdx(pTexCoord);
+    vec2 dy = dFdy(pTexCoord);
+    vec4 texel = vec4(0.0);
+    switch (pSlot)
+    {
+)";
+        for (unsigned int i = 0; i < MAX_TEXTURE_SLOTS; ++i)
+        {
+            std::string n = std::to_string(i);
+            source += "    case " + n + "u: texel = textureGrad(uTex[" + n + "], pTexCoord, dx, dy); break;\n";
+        }
+        source += R"(    }
+    fragColor = texel * pColor;
+})";
+        return source;
     }
 
     GLuint createShader(const char* vert, const char* frag)
@@ -274,7 +861,7 @@ void main()
 
     Texture* createFBO(int width, int height)
     {
-        Texture* fbo = new Texture();
+        Texture* fbo = mTexturePool.allocate();
         glGenFramebuffers(1, &fbo->mFramebufferID);
         SDL_assert_release(fbo->mFramebufferID);
 
@@ -292,6 +879,10 @@ void main()
 
         fbo->mWidth = width;
         fbo->mHeight = height;
+        fbo->mPageWidth = width;
+        fbo->mPageHeight = height;
+        fbo->mBytes = textureBytes(width, height, false);
+        mTextureBytes += fbo->mBytes;
 
         GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_NONE};
         glDrawBuffers(1, attachments);
@@ -312,14 +903,16 @@ void main()
         glGenBuffers(1, &vbo->mVertexBufferID);
         SDL_assert_release(vbo->mVertexBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, vbo->mVertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, numBytes, NULL, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, numBytes, NULL, GL_STREAM_DRAW);
 
         glEnableVertexAttribArray(0);
         glEnableVertexAttribArray(1);
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(2 * sizeof(float)));
-        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(4 * sizeof(float)));
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, mX));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, mU));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, mR));
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(Vertex), (void*)offsetof(Vertex, mSlot));
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
@@ -328,264 +921,1375 @@ void main()
         return vbo;
     }
 
-    Texture* textureFind(const std::string& path)
+    // Shared by every quad batch: quad i uses vertices 4i..4i+3 as (0, 1, 2) (2, 3, 0).
+    // Bound while mVAO is bound, so the binding is part of the VAO state.
+    GLuint createQuadIndexBuffer()
     {
-        if (mTextures.contains(path))
+        std::vector<uint16_t> indices(MAX_QUADS_PER_DRAW * 6);
+        for (unsigned int i = 0; i < MAX_QUADS_PER_DRAW; ++i)
         {
-            return mTextures[path];
+            indices[i * 6 + 0] = uint16_t(i * 4 + 0);
+            indices[i * 6 + 1] = uint16_t(i * 4 + 1);
+            indices[i * 6 + 2] = uint16_t(i * 4 + 2);
+            indices[i * 6 + 3] = uint16_t(i * 4 + 2);
+            indices[i * 6 + 4] = uint16_t(i * 4 + 3);
+            indices[i * 6 + 5] = uint16_t(i * 4 + 0);
         }
 
-        std::filesystem::path basePath = SDL_GetBasePath();
-        basePath.append("data");
-        basePath.append(path);
+        GLuint ibo;
+        glGenBuffers(1, &ibo);
+        SDL_assert_release(ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
 
-        size_t dataSize;
-        const stbi_uc* fileData = (const stbi_uc*)SDL_LoadFile(basePath.generic_string().c_str(), &dataSize);
+        return ibo;
+    }
 
-        if (!fileData)
+    // A texture still pending from textureFindAsync is returned as is, showing the placeholder.
+    Texture* textureFind(const std::string& path)
+    {
+        if (mTextures.contains(path))
         {
-            SDL_Log("Texture failed to load: %s", SDL_GetError());
+            mTextureStats.mHits++;
+            return mTextures[path];
         }
+        mTextureStats.mMisses++;
 
-        Texture* tex = new Texture();
-        int c;
-        unsigned char* data = stbi_load_from_memory(fileData, dataSize, &tex->mWidth, &tex->mHeight, &c, 0);
-
-        SDL_free((void*)fileData);
-
-        if (!data)
+        Image image;
+        if (!loadImage(path, image))
         {
-            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Texture failed to load: %s", basePath.generic_string().c_str());
             return nullptr;
         }
-        else
-        {
-            SDL_Log("Texture loaded: %s %dx%d", basePath.generic_string().c_str(), tex->mWidth, tex->mHeight);
-        }
 
-        glGenTextures(1, &tex->mTexID);
-        SDL_assert_release(tex->mTexID);
-        glBindTexture(GL_TEXTURE_2D, tex->mTexID);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        if (c == 3)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, tex->mWidth, tex->mHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        }
-        else if (c == 4)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex->mWidth, tex->mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        stbi_image_free(data);
-
-        glBindTexture(GL_TEXTURE_2D, 0);
+        Texture* tex = uploadImage(path, image.mPixels, image.mWidth, image.mHeight, image.mChannels);
+        freeImage(image);
 
         mTextures[path] = tex;
 
         return mTextures[path];
     }
 
-    void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a)
+    // Returns right away with a texture that shows a transparent placeholder.
+    // The image is decoded on a worker thread and replaces the placeholder in place, so the pointer stays valid.
+    Texture* textureFindAsync(const std::string& path)
     {
-        // (-1,  1)  - ( 1,  1)
-        //     |           |
-        // (-1, -1)  - ( 1, -1)
-
-        float sourceX = sx / tex->mWidth;
-        float sourceY = sy / tex->mHeight;
-        float sourceW = (sx + sw) / tex->mWidth;
-        float sourceH = (sy + sh) / tex->mHeight;
-
-        Vertex topLeft;
-        topLeft.mX = -(sw / 2.0f);
-        topLeft.mY = (sh / 2.0f);
-        topLeft.mU = sourceX;
-        topLeft.mV = sourceY;
-        topLeft.mR = r;
-        topLeft.mG = g;
-        topLeft.mB = b;
-        topLeft.mA = a;
-
-        Vertex topRight;
-        topRight.mX = (sw / 2.0f);
-        topRight.mY = (sh / 2.0f);
-        topRight.mU = sourceW;
-        topRight.mV = sourceY;
-        topRight.mR = r;
-        topRight.mG = g;
-        topRight.mB = b;
-        topRight.mA = a;
-
-        Vertex bottomLeft;
-        bottomLeft.mX = -(sw / 2.0f);
-        bottomLeft.mY = -(sh / 2.0f);
-        bottomLeft.mU = sourceX;
-        bottomLeft.mV = sourceH;
-        bottomLeft.mR = r;
-        bottomLeft.mG = g;
-        bottomLeft.mB = b;
-        bottomLeft.mA = a;
-
-        Vertex bottomRight;
-        bottomRight.mX = (sw / 2.0f);
-        bottomRight.mY = -(sh / 2.0f);
-        bottomRight.mU = sourceW;
-        bottomRight.mV = sourceH;
-        bottomRight.mR = r;
-        bottomRight.mG = g;
-        bottomRight.mB = b;
-        bottomRight.mA = a;
-
-        FrameData& frame = getCurrentFrame();
+        if (mTextures.contains(path))
+        {
+            mTextureStats.mHits++;
+            return mTextures[path];
+        }
+        mTextureStats.mMisses++;
 
-        if (frame.mVertices.size() + 6 >= MAX_VERTEX)
+        if (!mTextureLoader.isRunning())
         {
-            flush();
+            unsigned int numWorkers = std::clamp(SDL_GetNumLogicalCPUCores() - 1, 1, 4);
+            mTextureLoader.startup([this](const std::string& imagePath, Image& image) { return loadImage(imagePath, image); }, numWorkers);
         }
 
-        frame.mTextures.emplace_back(tex);
+        Texture* tex = mTexturePool.allocate();
+        *tex = *mPlaceholderTexture;
+        tex->mPending = true;
+        tex->mBytes = 0;
+        mTextures[path] = tex;
+        mPendingTextureCount++;
 
-        glm::mat4 Translate = glm::translate(glm::mat4(1.0f), glm::vec3(dx, dy, 0.0f));
-        glm::mat4 Rotate = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f));
-        glm::mat4 Scale = glm::scale(glm::mat4(1.0f), glm::vec3(scaleX, scaleY, 1.0f));
-        glm::mat4 TRS = Translate * Rotate * Scale;
+        mTextureLoader.request(path);
 
-        glm::vec4 v;
+        return tex;
+    }
 
-        v = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        v.x = topLeft.mX;
-        v.y = topLeft.mY;
-        v = TRS * v;
-        topLeft.mX = v.x;
-        topLeft.mY = v.y;
+    bool isTextureLoaded(Texture* tex)
+    {
+        return !tex->mPending;
+    }
 
-        v = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        v.x = topRight.mX;
-        v.y = topRight.mY;
-        v = TRS * v;
-        topRight.mX = v.x;
-        topRight.mY = v.y;
+    Handle getTextureHandle(Texture* tex)
+    {
+        return mTexturePool.handleOf(tex);
+    }
 
-        v = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        v.x = bottomLeft.mX;
-        v.y = bottomLeft.mY;
-        v = TRS * v;
-        bottomLeft.mX = v.x;
-        bottomLeft.mY = v.y;
+    // nullptr once the texture was deleted
+    Texture* resolveTexture(Handle handle)
+    {
+        return mTexturePool.get(handle);
+    }
 
-        v = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        v.x = bottomRight.mX;
-        v.y = bottomRight.mY;
-        v = TRS * v;
-        bottomRight.mX = v.x;
-        bottomRight.mY = v.y;
+    Handle getFontHandle(TTF_Font* font)
+    {
+        auto found = mFontHandles.find(font);
+        return found != mFontHandles.end() ? found->second : 0;
+    }
 
-        frame.mVertices.emplace_back(topLeft);
-        frame.mVertices.emplace_back(bottomLeft);
-        frame.mVertices.emplace_back(bottomRight);
+    TTF_Font* resolveFont(Handle handle)
+    {
+        TTF_Font** font = mFontPool.get(handle);
+        return font ? *font : nullptr;
+    }
 
-        frame.mVertices.emplace_back(bottomRight);
-        frame.mVertices.emplace_back(topRight);
-        frame.mVertices.emplace_back(topLeft);
+    Handle getTextHandle(TextObject* obj)
+    {
+        return mTextPool.handleOf(obj);
     }
 
-    void flush()
+    TextObject* resolveText(Handle handle)
     {
-        FrameData& frame = getCurrentFrame();
+        return mTextPool.get(handle);
+    }
 
-        if (frame.mVertices.empty())
+    void pinTexture(Texture* tex)
+    {
+        if (tex)
         {
-            return;
+            mPinnedTextures.insert(tex);
         }
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, frame.mVertexBuffer->mVertexBufferID);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * frame.mVertices.size(), &frame.mVertices[0]);
-
-        unsigned int j = 0;
-        for (unsigned int i = 0; i < frame.mVertices.size(); i += 6)
+    void pinFont(TTF_Font* font)
+    {
+        if (font)
         {
-            Texture* tex = frame.mTextures[j];
-            glBindTexture(GL_TEXTURE_2D, tex->mTexID);
-            ++j;
-            glDrawArrays(GL_TRIANGLES, i, 6);
+            mPinnedFonts.insert(font);
         }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        frame.mVertices.clear();
-        frame.mTextures.clear();
     }
 
-    TTF_Font* fontFind(const std::string& path, float ptSize)
+    void retainTexture(Texture* tex)
     {
-        std::string key = path + "#" + std::to_string((int)ptSize);
+        mTextureRefs[tex]++;
+    }
 
-        if (mFonts.contains(key))
+    void releaseTexture(Texture* tex)
+    {
+        if (--mTextureRefs[tex] == 0)
         {
-            return mFonts[key];
+            mUnusedTextures.push_back(tex);
         }
+    }
 
-        std::filesystem::path basePath = SDL_GetBasePath();
-        basePath.append("data");
-        basePath.append(path);
-
-        TTF_Font* font = TTF_OpenFont(basePath.generic_string().c_str(), ptSize);
-        if (!font)
+    void retainFont(TTF_Font* font)
+    {
+        if (font)
         {
-            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Font failed to load: %s", SDL_GetError());
+            mFontRefs[font]++;
         }
-        else
+    }
+
+    void releaseFont(TTF_Font* font)
+    {
+        if (font && --mFontRefs[font] == 0)
         {
-            SDL_Log("Font loaded: %s", basePath.generic_string().c_str());
+            mUnusedFonts.push_back(font);
         }
+    }
 
-        mFonts[key] = font;
+    // Unloads textures and fonts that are still unreferenced since their last release.
+    // Pinned objects and atlas entries stay, pending textures wait for their upload.
+    void unloadUnusedResources()
+    {
+        std::vector<Texture*> waiting;
+        for (Texture* tex : mUnusedTextures)
+        {
+            auto ref = mTextureRefs.find(tex);
+            if (ref == mTextureRefs.end() || ref->second > 0)
+            {
+                continue;
+            }
+            if (tex->mPending)
+            {
+                waiting.push_back(tex);
+                continue;
+            }
+            mTextureRefs.erase(ref);
+            if (!mPinnedTextures.contains(tex) && !isAtlasEntry(tex))
+            {
+                unloadTexture(tex);
+            }
+        }
+        mUnusedTextures = std::move(waiting);
 
-        return mFonts[key];
+        for (TTF_Font* font : mUnusedFonts)
+        {
+            auto ref = mFontRefs.find(font);
+            if (ref == mFontRefs.end() || ref->second > 0)
+            {
+                continue;
+            }
+            mFontRefs.erase(ref);
+            if (!mPinnedFonts.contains(font))
+            {
+                unloadFont(font);
+            }
+        }
+        mUnusedFonts.clear();
     }
 
-    void drawText(TTF_Font* font, float x, float y, const std::string& text, float r, float g, float b, float a)
+    void unloadTexture(Texture* tex)
     {
-        SDL_Color color = {Uint8(r * 255), Uint8(g * 255), Uint8(b * 255), Uint8(a * 255)};
-        SDL_Surface* surf = TTF_RenderText_Blended_Wrapped(font, text.c_str(), 0, color, 0);
-        if (!surf)
+        for (auto i = mTextures.begin(); i != mTextures.end(); ++i)
         {
-            SDL_Log("%s", SDL_GetError());
+            if (i->second == tex)
+            {
+                SDL_Log("Texture unloaded: %s", i->first.c_str());
+                mTextures.erase(i);
+                break;
+            }
         }
+        mEvictedPaths.erase(tex);
+        deleteTexture(tex);
+    }
 
-        SDL_Surface* rgbaSurf = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_ABGR8888);
-        if (!rgbaSurf)
+    void unloadFont(TTF_Font* font)
+    {
+        std::unordered_map<uint64_t, Glyph>& glyphs = mGlyphs[font];
+        // glyphs too large for the atlas have textures of their own, those are freed and rasterized again on reload
+        std::erase_if(glyphs, [this](auto& i) {
+            Texture* tex = i.second.mTexture;
+            if (tex && !isAtlasEntry(tex))
+            {
+                deleteTexture(tex);
+                return true;
+            }
+            return false;
+        });
+
+        for (auto i = mFonts.begin(); i != mFonts.end(); ++i)
         {
-            SDL_Log("%s", SDL_GetError());
+            if (i->second == font)
+            {
+                SDL_Log("Font unloaded: %s", i->first.c_str());
+                mUnloadedGlyphs[i->first].swap(glyphs);
+                mFonts.erase(i);
+                break;
+            }
         }
-        SDL_DestroySurface(surf);
+        deleteGlyphs(glyphs);
+        mGlyphs.erase(font);
+
+        mFontPool.release(mFontPool.get(mFontHandles[font]));
+        mFontHandles.erase(font);
+        TTF_CloseFont(font);
+    }
+
+    void deleteGlyphs(std::unordered_map<uint64_t, Glyph>& glyphs)
+    {
+        for (auto& [key, glyph] : glyphs)
+        {
+            if (glyph.mTexture)
+            {
+                deleteTexture(glyph.mTexture);
+            }
+        }
+        glyphs.clear();
+    }
+
+    // uploads images finished by the loader until this frame's byte budget is spent
+    void processTextureUploads()
+    {
+        size_t uploadedBytes = 0;
+        DecodedImage decoded;
+        while (uploadedBytes < mTextureUploadBudget && mTextureLoader.poll(decoded))
+        {
+            Image& image = decoded.mImage;
+            mPendingTextureCount--;
+
+            auto found = mTextures.find(decoded.mPath);
+            if (found == mTextures.end())
+            {
+                // nothing is waiting for the image any more
+                freeImage(image);
+                continue;
+            }
+            Texture* tex = found->second;
+
+            if (!image.mPixels)
+            {
+                // keeps showing the placeholder, loadImage has logged the failure
+                tex->mPending = false;
+                continue;
+            }
+
+            // filter settings requested while the placeholder was showing
+            bool linear = tex->mLinearFilter;
+            bool mipmaps = tex->mMipmapped;
+
+            Texture* uploaded = uploadImage(decoded.mPath, image.mPixels, image.mWidth, image.mHeight, image.mChannels);
+            *tex = *uploaded;
+            mTexturePool.release(uploaded);
+
+            if (linear || mipmaps)
+            {
+                setTextureFilter(tex, linear, mipmaps);
+            }
+
+            uploadedBytes += size_t(image.mWidth) * image.mHeight * image.mChannels;
+            freeImage(image);
+        }
+    }
+
+    void setTextureUploadBudget(size_t bytes)
+    {
+        mTextureUploadBudget = bytes;
+    }
+
+    // places decoded pixels into the path's atlas group, the shared atlas or a texture of their own
+    Texture* uploadImage(const std::string& path, const unsigned char* data, int width, int height, int channels)
+    {
+        Texture* tex = nullptr;
+
+        auto group = mAtlasGroupOfPath.find(path);
+        if (group != mAtlasGroupOfPath.end())
+        {
+            tex = atlasInsert(group->second, data, width, height, channels);
+        }
+        else if (mAtlasEnabled)
+        {
+            tex = atlasInsert("", data, width, height, channels);
+        }
+
+        if (!tex)
+        {
+            tex = createTexture(data, width, height, channels);
+            if (mTextureMipmapsOnLoad)
+            {
+                setTextureFilter(tex, false, true);
+            }
+        }
+
+        return tex;
+    }
+
+    bool isAtlasEntry(Texture* tex)
+    {
+        return tex->mWidth != tex->mPageWidth || tex->mHeight != tex->mPageHeight;
+    }
+
+    // Sets how a standalone texture is sampled. With mipmaps a chain is generated from level 0,
+    // so scaled down sprites read from a level close to their size on screen instead of skipping over level 0.
+    // Atlas entries share their page's sampler and are left alone.
+    void setTextureFilter(Texture* tex, bool linear, bool mipmaps)
+    {
+        if (tex->mPending)
+        {
+            // applied once the image replaces the shared placeholder
+            tex->mLinearFilter = linear;
+            tex->mMipmapped = mipmaps;
+            return;
+        }
+
+        if (isAtlasEntry(tex))
+        {
+            SDL_Log("setTextureFilter: atlas entries use the filter of their page");
+            return;
+        }
+
+        GLint magFilter = linear ? GL_LINEAR : GL_NEAREST;
+        GLint minFilter = magFilter;
+        if (mipmaps)
+        {
+            minFilter = linear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, tex->mTexID);
+        if (mipmaps)
+        {
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            size_t bytes = textureBytes(tex->mWidth, tex->mHeight, true);
+            mTextureBytes += bytes - tex->mBytes;
+            tex->mBytes = bytes;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        tex->mLinearFilter = linear;
+        tex->mMipmapped = mipmaps;
+        mRedrawRequested = true;
+    }
+
+    void setTextureMipmapsOnLoad(bool enabled)
+    {
+        mTextureMipmapsOnLoad = enabled;
+    }
+
+    // Frees the GL objects the Texture owns, then the Texture itself.
+    // Plain standalone storage goes back to the transient pool, mip chains and render targets are deleted.
+    void deleteTexture(Texture* tex)
+    {
+        // a texture created later may get the same slot and GL name, which the frame hash cannot tell apart
+        mRedrawRequested = true;
+        if (tex->mFramebufferID)
+        {
+            glDeleteFramebuffers(1, &tex->mFramebufferID);
+        }
+        if (tex->mBytes)
+        {
+            if (tex->mFramebufferID || tex->mMipmapped)
+            {
+                mTransientTextures.destroy(tex->mTexID);
+            }
+            else
+            {
+                mTransientTextures.release(tex->mTexID, mFrameNumber + FRAME_OVERLAP);
+            }
+            mTextureBytes -= tex->mBytes;
+        }
+        mTexturePool.release(tex);
+    }
+
+    void setTextureBudget(size_t bytes)
+    {
+        mTextureBudget = bytes;
+    }
+
+    TextureStats getTextureStats()
+    {
+        TextureStats stats = mTextureStats;
+        stats.mResidentBytes = mTextureBytes;
+        stats.mBudgetBytes = mTextureBudget;
+        return stats;
+    }
+
+    // Evicts textures loaded from a path, least recently drawn first, until the budget is met.
+    // Textures drawn by frames the GPU may still be working on are kept, as are atlas entries,
+    // which share their page.
+    void enforceTextureBudget()
+    {
+        if (mTextureBudget == 0 || mTextureBytes + mTransientTextures.mIdleBytes <= mTextureBudget)
+        {
+            return;
+        }
+
+        // idle pooled storage goes first, it backs no visible texture
+        mTransientTextures.trim();
+        if (mTextureBytes <= mTextureBudget)
+        {
+            return;
+        }
+
+        std::vector<std::pair<const std::string*, Texture*>> candidates;
+        for (auto& [path, tex] : mTextures)
+        {
+            if (tex->mBytes && !tex->mPending && tex->mLastUsedFrame + FRAME_OVERLAP <= mFrameNumber)
+            {
+                candidates.push_back({&path, tex});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.second->mLastUsedFrame < b.second->mLastUsedFrame; });
+
+        for (auto& [path, tex] : candidates)
+        {
+            if (mTextureBytes <= mTextureBudget)
+            {
+                break;
+            }
+            evictTexture(*path, tex);
+        }
+    }
+
+    void evictTexture(const std::string& path, Texture* tex)
+    {
+        mEvictedPaths[tex] = path;
 
-        Texture* tex = new Texture();
-        tex->mWidth = rgbaSurf->w;
-        tex->mHeight = rgbaSurf->h;
+        // evicting is meant to give the memory back, so the storage is not pooled
+        mTransientTextures.destroy(tex->mTexID);
+        mTextureBytes -= tex->mBytes;
+        tex->mTexID = 0;
+        tex->mBytes = 0;
+        tex->mEvicted = true;
 
-        glGenTextures(1, &tex->mTexID);
-        SDL_assert_release(tex->mTexID);
+        mTextureStats.mEvictions++;
+    }
+
+    // Loads an evicted texture again into the same Texture, so pointers held by scripts stay valid.
+    // Falls back to the placeholder when the image is gone.
+    void reloadTexture(Texture* tex)
+    {
+        std::string path = mEvictedPaths[tex];
+        mEvictedPaths.erase(tex);
+        mTextureStats.mReloads++;
+
+        bool linear = tex->mLinearFilter;
+        bool mipmaps = tex->mMipmapped;
+
+        Image image;
+        if (!loadImage(path, image))
+        {
+            int width = tex->mWidth;
+            int height = tex->mHeight;
+            *tex = *mPlaceholderTexture;
+            tex->mWidth = width;
+            tex->mHeight = height;
+            tex->mBytes = 0;
+            return;
+        }
+
+        Texture* reloaded = createTexture(image.mPixels, image.mWidth, image.mHeight, image.mChannels);
+        freeImage(image);
+        *tex = *reloaded;
+        mTexturePool.release(reloaded);
+
+        if (linear || mipmaps)
+        {
+            setTextureFilter(tex, linear, mipmaps);
+        }
+    }
+
+    // Loads data/path, from its cooked copy when that is still up to date, otherwise by decoding the source
+    // from the asset pack or loose file and cooking it for the next run. Safe to call from the loader threads.
+    bool loadImage(const std::string& path, Image& image)
+    {
+        std::filesystem::path cookedPath;
+        int64_t sourceTime = 0;
+        uint64_t sourceSize = 0;
+        // paths that would leave the cache directory are never cooked
+        if (mTextureCacheEnabled && !mTextureCachePath.empty() && statAsset(path, sourceTime, sourceSize) && getCookedTexturePath(mTextureCachePath, path, cookedPath))
+        {
+            if (readCookedTexture(cookedPath, sourceTime, sourceSize, image))
+            {
+                SDL_Log("Texture loaded: %s %dx%d (cooked)", path.c_str(), image.mWidth, image.mHeight);
+                return true;
+            }
+        }
+
+        AssetData asset;
+        if (!loadAsset(path, asset))
+        {
+            SDL_Log("Texture failed to load: %s", SDL_GetError());
+        }
+
+        image.mDecoded = stbi_load_from_memory(asset.mData, int(asset.mSize), &image.mWidth, &image.mHeight, &image.mChannels, 0);
+        image.mPixels = image.mDecoded;
+
+        freeAsset(asset);
+
+        if (!image.mDecoded)
+        {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Texture failed to load: %s", path.c_str());
+            return false;
+        }
+
+        SDL_Log("Texture loaded: %s %dx%d", path.c_str(), image.mWidth, image.mHeight);
+
+        if (!cookedPath.empty() && (image.mChannels == 3 || image.mChannels == 4))
+        {
+            writeCookedTexture(cookedPath, image, sourceTime, sourceSize);
+        }
+
+        return true;
+    }
+
+    Texture* createTexture(const unsigned char* data, int width, int height, int channels)
+    {
+        mRedrawRequested = true;
+        Texture* tex = mTexturePool.allocate();
+        tex->mWidth = width;
+        tex->mHeight = height;
+        tex->mPageWidth = width;
+        tex->mPageHeight = height;
+        tex->mBytes = textureBytes(width, height, false);
+        mTextureBytes += tex->mBytes;
+
+        // storage comes from the transient pool when a texture of this size was deleted recently
+        tex->mTexID = mTransientTextures.acquire(width, height, channels == 3 ? GL_RGB8 : GL_RGBA8);
         glBindTexture(GL_TEXTURE_2D, tex->mTexID);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (channels == 3)
+        {
+            mTextureUploader.texSubImage(tex->mTexID, 0, 0, width, height, GL_RGB, data);
+        }
+        else if (channels == 4)
+        {
+            mTextureUploader.texSubImage(tex->mTexID, 0, 0, width, height, GL_RGBA, data);
+        }
+
+        return tex;
+    }
+
+    // RGBA8 texture meant to be rewritten often, such as video frames or a procedurally drawn canvas.
+    // Starts out transparent.
+    Texture* createDynamicTexture(int width, int height)
+    {
+        std::vector<unsigned char> clear(size_t(width) * height * 4, 0);
+        return createTexture(clear.data(), width, height, 4);
+    }
+
+    // Replaces the contents with width * height tightly packed RGBA8 texels.
+    // The copy is staged in a pixel buffer, so neither this call nor the frame waits for the GPU.
+    // Draws of this frame that are not flushed yet see the new contents.
+    void updateDynamicTexture(Texture* tex, const unsigned char* pixels)
+    {
+        mTextureUploader.texSubImage(tex->mTexID, tex->mAtlasX, tex->mAtlasY, tex->mWidth, tex->mHeight, GL_RGBA, pixels);
+        mRedrawRequested = true;
+
+        if (tex->mMipmapped)
+        {
+            glBindTexture(GL_TEXTURE_2D, tex->mTexID);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    // Packs the image into a page of the given group.
+    // Returns nullptr when the image is too large for the atlas, the caller then creates a standalone texture.
+    // Atlas entries can not use GL_REPEAT, source rects outside the image sample the neighbouring entries.
+    Texture* atlasInsert(const std::string& groupName, const unsigned char* data, int width, int height, int channels)
+    {
+        if (width > mAtlasMaxEntrySize || height > mAtlasMaxEntrySize || (channels != 3 && channels != 4))
+        {
+            return nullptr;
+        }
+
+        // one texel of padding keeps neighbouring entries out of each other's footprint
+        const int padding = 1;
+        AtlasGroup& group = mAtlasGroups[groupName];
+
+        int x, y;
+        AtlasPage* page = nullptr;
+        for (AtlasPage& i : group.mPages)
+        {
+            if (i.mPacker.pack(width + padding * 2, height + padding * 2, x, y))
+            {
+                page = &i;
+                break;
+            }
+        }
+
+        if (!page)
+        {
+            AtlasPage& newPage = group.mPages.emplace_back();
+            std::vector<unsigned char> clear(size_t(mAtlasPageSize) * mAtlasPageSize * 4, 0);
+            newPage.mTexture = mTexturePool.allocate();
+            newPage.mTexture->mWidth = mAtlasPageSize;
+            newPage.mTexture->mHeight = mAtlasPageSize;
+            newPage.mTexture->mPageWidth = mAtlasPageSize;
+            newPage.mTexture->mPageHeight = mAtlasPageSize;
+            newPage.mTexture->mBytes = textureBytes(mAtlasPageSize, mAtlasPageSize, false);
+            mTextureBytes += newPage.mTexture->mBytes;
+
+            glGenTextures(1, &newPage.mTexture->mTexID);
+            SDL_assert_release(newPage.mTexture->mTexID);
+            glBindTexture(GL_TEXTURE_2D, newPage.mTexture->mTexID);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mAtlasPageSize, mAtlasPageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            mTextureUploader.texSubImage(newPage.mTexture->mTexID, 0, 0, mAtlasPageSize, mAtlasPageSize, GL_RGBA, clear.data());
+
+            newPage.mPacker.reset(mAtlasPageSize, mAtlasPageSize);
+            if (!newPage.mPacker.pack(width + padding * 2, height + padding * 2, x, y))
+            {
+                return nullptr;
+            }
+            page = &newPage;
+
+            SDL_Log("Atlas page created: group \"%s\" page %d", groupName.c_str(), (int)group.mPages.size() - 1);
+        }
+
+        mRedrawRequested = true;
+        Texture* tex = mTexturePool.allocate();
+        tex->mTexID = page->mTexture->mTexID;
+        tex->mWidth = width;
+        tex->mHeight = height;
+        tex->mAtlasX = x + padding;
+        tex->mAtlasY = y + padding;
+        tex->mPageWidth = mAtlasPageSize;
+        tex->mPageHeight = mAtlasPageSize;
+
+        mTextureUploader.texSubImage(tex->mTexID, tex->mAtlasX, tex->mAtlasY, width, height, channels == 4 ? GL_RGBA : GL_RGB, data);
+
+        return tex;
+    }
+
+    // Loads the listed images into one atlas group right away.
+    // Packing them together, tallest first, gives a tighter layout than on-demand loading.
+    void textureAtlasGroup(const std::string& groupName, const std::vector<std::string>& paths)
+    {
+        struct Pending {
+            std::string mPath;
+            Image mImage;
+        };
+
+        std::vector<Pending> pending;
+        for (const std::string& path : paths)
+        {
+            mAtlasGroupOfPath[path] = groupName;
+            if (mTextures.contains(path))
+            {
+                continue;
+            }
+
+            Pending p;
+            p.mPath = path;
+            if (loadImage(path, p.mImage))
+            {
+                pending.push_back(p);
+            }
+        }
+
+        std::stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) { return a.mImage.mHeight > b.mImage.mHeight; });
+
+        for (Pending& p : pending)
+        {
+            const Image& image = p.mImage;
+            Texture* tex = atlasInsert(groupName, image.mPixels, image.mWidth, image.mHeight, image.mChannels);
+            if (!tex)
+            {
+                tex = createTexture(image.mPixels, image.mWidth, image.mHeight, image.mChannels);
+            }
+            freeImage(p.mImage);
+
+            mTextures[p.mPath] = tex;
+        }
+    }
+
+    void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a, int layer = 0)
+    {
+        SpriteDesc sprite = {tex, sx, sy, sw, sh, scaleX, scaleY, angle, dx, dy, r, g, b, a};
+        drawTextures(&sprite, 1, layer);
+    }
+
+    // Queues the sprites with a sort key, nothing is batched until flush.
+    // Lower layers are drawn first, within a layer submission order is kept unless the layer allows reordering.
+    // The queue holds the whole frame, only a frame of more than MAX_QUEUED_COMMANDS sprites is sorted in parts.
+    void drawTextures(const SpriteDesc* sprites, size_t count, int layer = 0)
+    {
+        FrameData& frame = getCurrentFrame();
+        bool reorder = mReorderLayers[std::clamp(layer, -32768, 32767) + 32768];
+
+        while (count > 0)
+        {
+            if (frame.mCommands.size() >= MAX_QUEUED_COMMANDS)
+            {
+                SDL_Log("drawTextures: more than %zu sprites in one frame, layer order only holds within each part", MAX_QUEUED_COMMANDS);
+                flush();
+                mFlushedMidFrame = true;
+            }
+            size_t n = std::min(count, MAX_QUEUED_COMMANDS - frame.mCommands.size());
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                Texture* tex = sprites[i].mTexture;
+                if (tex->mEvicted)
+                {
+                    reloadTexture(tex);
+                }
+                tex->mLastUsedFrame = mFrameNumber;
+
+                if (mRedrawOnDemand)
+                {
+                    uint64_t id = uint64_t(uintptr_t(tex));
+                    uint32_t identity[4] = {uint32_t(id), uint32_t(id >> 32), tex->mTexID, uint32_t(layer)};
+                    mFrameHash = hashWords(mFrameHash, identity, 4);
+                    mFrameHash = hashWords(mFrameHash, &sprites[i].mSX, 13);
+                }
+
+                unsigned int texture = reorder ? getSortTexture(frame, tex->mTexID) : 0;
+                frame.mSortKeys.push_back(makeSortKey(layer, 0, texture, uint32_t(frame.mCommands.size())));
+                frame.mCommands.push_back(sprites[i]);
+            }
+
+            sprites += n;
+            count -= n;
+        }
+    }
+
+    // GL names are sparse and would collide once masked to the key's 20 bits, a frame numbers its textures densely instead
+    uint32_t getSortTexture(FrameData& frame, GLuint texID)
+    {
+        auto [it, inserted] = frame.mSortTextures.try_emplace(texID, uint32_t(frame.mSortTextures.size()));
+        return it->second;
+    }
+
+    // Within a reordering layer sprites are grouped by texture, which lets them share batches,
+    // at the cost of overlapping sprites in that layer no longer drawing in submission order.
+    // Sprites already queued keep the order their key was made with.
+    void setLayerReorder(int layer, bool enabled)
+    {
+        size_t index = size_t(std::clamp(layer, -32768, 32767) + 32768);
+        if (mReorderLayers[index] != enabled)
+        {
+            // changes the draw order without changing what the frame hash sees
+            mRedrawRequested = true;
+            mReorderLayers[index] = enabled;
+        }
+    }
+
+    // sorts the queued commands and turns them into as few batches as the texture slots allow
+    void flush()
+    {
+        FrameData& frame = getCurrentFrame();
+
+        if (frame.mCommands.empty())
+        {
+            return;
+        }
+        bindRenderTarget();
+
+        radixSortKeys(frame.mSortKeys, frame.mSortScratch);
+
+        frame.mSortedCommands.resize(frame.mCommands.size());
+        for (size_t i = 0; i < frame.mSortKeys.size(); ++i)
+        {
+            frame.mSortedCommands[i] = frame.mCommands[frame.mSortKeys[i] & SORT_KEY_SEQUENCE_MASK];
+        }
+
+        recordSprites(frame, frame.mSortedCommands.data(), frame.mSortedCommands.size());
+        drawBatch();
+
+        frame.mCommands.clear();
+        frame.mSortKeys.clear();
+    }
+
+    // Vertex positions of a whole run are generated by the transformSprites kernel.
+    // A batch is drawn once it holds mMaxBatchQuads sprites or its texture slots are full.
+    void recordSprites(FrameData& frame, const SpriteDesc* sprites, size_t count)
+    {
+        while (count > 0)
+        {
+            size_t n = std::min(count, mMaxBatchQuads - frame.mQuadCount);
+
+            // stops at the first sprite whose texture finds the slot table full
+            size_t accepted = 0;
+            if (mInstancedSprites)
+            {
+                for (; accepted < n; ++accepted)
+                {
+                    int slot = acquireTextureSlot(frame, sprites[accepted].mTexture);
+                    if (slot < 0)
+                    {
+                        break;
+                    }
+                    pushSpriteInstance(frame, sprites[accepted], slot);
+                }
+            }
+            else
+            {
+                size_t first = frame.mVertices.size();
+                frame.mVertices.resize(first + n * 4);
+                Vertex* vertices = &frame.mVertices[first];
+
+                for (; accepted < n; ++accepted)
+                {
+                    int slot = acquireTextureSlot(frame, sprites[accepted].mTexture);
+                    if (slot < 0)
+                    {
+                        break;
+                    }
+                    pushSpriteVertices(sprites[accepted], slot, vertices + accepted * 4);
+                }
+                frame.mVertices.resize(first + accepted * 4);
+                transformSprites(sprites, accepted, vertices);
+            }
+            frame.mQuadCount += accepted;
+
+            if (accepted < n || frame.mQuadCount >= mMaxBatchQuads)
+            {
+                drawBatch();
+            }
+
+            sprites += accepted;
+            count -= accepted;
+        }
+    }
+
+    // returns the unit the texture is bound to in the current batch, or -1 when all units are taken
+    int acquireTextureSlot(FrameData& frame, Texture* tex)
+    {
+        for (unsigned int i = 0; i < frame.mSlotCount; ++i)
+        {
+            if (frame.mSlotTextures[i] == tex->mTexID)
+            {
+                return i;
+            }
+        }
+
+        if (frame.mSlotCount >= mTextureSlots)
+        {
+            return -1;
+        }
+
+        frame.mSlotTextures[frame.mSlotCount] = tex->mTexID;
+        return frame.mSlotCount++;
+    }
+
+    // fills texture coordinates, color and slot, positions are left to transformSprites
+    void pushSpriteVertices(const SpriteDesc& sprite, int slot, Vertex* v)
+    {
+        // (-1,  1)  - ( 1,  1)
+        //     |           |
+        // (-1, -1)  - ( 1, -1)
+
+        Texture* tex = sprite.mTexture;
+
+        float sourceX = (tex->mAtlasX + sprite.mSX) / tex->mPageWidth;
+        float sourceY = (tex->mAtlasY + sprite.mSY) / tex->mPageHeight;
+        float sourceW = (tex->mAtlasX + sprite.mSX + sprite.mSW) / tex->mPageWidth;
+        float sourceH = (tex->mAtlasY + sprite.mSY + sprite.mSH) / tex->mPageHeight;
+
+        uint8_t r = toUnorm8(sprite.mR);
+        uint8_t g = toUnorm8(sprite.mG);
+        uint8_t b = toUnorm8(sprite.mB);
+        uint8_t a = toUnorm8(sprite.mA);
+
+        // top-left, bottom-left, bottom-right, top-right
+        const float us[4] = {sourceX, sourceX, sourceW, sourceW};
+        const float vs[4] = {sourceY, sourceH, sourceH, sourceY};
+        for (int i = 0; i < 4; ++i)
+        {
+            v[i].mU = us[i];
+            v[i].mV = vs[i];
+            v[i].mR = r;
+            v[i].mG = g;
+            v[i].mB = b;
+            v[i].mA = a;
+            v[i].mSlot = uint8_t(slot);
+        }
+    }
+
+    void pushSpriteInstance(FrameData& frame, const SpriteDesc& sprite, int slot)
+    {
+        Texture* tex = sprite.mTexture;
+
+        SpriteInstance& instance = frame.mInstances.emplace_back();
+        instance.mX = sprite.mDX;
+        instance.mY = sprite.mDY;
+        instance.mWidth = sprite.mSW * sprite.mScaleX;
+        instance.mHeight = sprite.mSH * sprite.mScaleY;
+        instance.mAngle = sprite.mAngle;
+        instance.mU0 = (tex->mAtlasX + sprite.mSX) / tex->mPageWidth;
+        instance.mV0 = (tex->mAtlasY + sprite.mSY) / tex->mPageHeight;
+        instance.mU1 = (tex->mAtlasX + sprite.mSX + sprite.mSW) / tex->mPageWidth;
+        instance.mV1 = (tex->mAtlasY + sprite.mSY + sprite.mSH) / tex->mPageHeight;
+        instance.mColor[0] = toUnorm8(sprite.mR);
+        instance.mColor[1] = toUnorm8(sprite.mG);
+        instance.mColor[2] = toUnorm8(sprite.mB);
+        instance.mColor[3] = toUnorm8(sprite.mA);
+        instance.mSlot = uint8_t(slot);
+    }
+
+    void drawBatch()
+    {
+        FrameData& frame = getCurrentFrame();
+
+        if (frame.mQuadCount == 0)
+        {
+            return;
+        }
+
+        for (unsigned int i = 0; i < frame.mSlotCount; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, frame.mSlotTextures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex->mWidth, tex->mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgbaSurf->pixels);
+        if (!frame.mInstances.empty())
+        {
+            flushInstances(frame);
+        }
+        else
+        {
+            flushVertices(frame);
+        }
+        mStats.mQuads += frame.mQuadCount;
 
         glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        SDL_DestroySurface(rgbaSurf);
+        frame.mVertices.clear();
+        frame.mInstances.clear();
+        frame.mSlotCount = 0;
+        frame.mQuadCount = 0;
+    }
+
+    void flushVertices(FrameData& frame)
+    {
+        GLintptr offset = uploadStream(frame.mVertices.data(), sizeof(Vertex) * frame.mVertices.size(), sizeof(Vertex));
+        GLint baseVertex = GLint(offset / sizeof(Vertex));
+
+        glUseProgram(mShader);
+        glUniformMatrix4fv(mMVPLocation, 1, GL_FALSE, glm::value_ptr(mProjection));
+        glBindVertexArray(mVAO);
+
+        unsigned int numQuads = frame.mQuadCount;
+        for (unsigned int first = 0; first < numQuads; first += MAX_QUADS_PER_DRAW)
+        {
+            unsigned int count = std::min(numQuads - first, MAX_QUADS_PER_DRAW);
+            glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, 0, baseVertex + first * 4);
+
+            mStats.mDrawCalls++;
+            mStats.mMaxBatchQuads = std::max(mStats.mMaxBatchQuads, count);
+        }
+    }
+
+    void flushInstances(FrameData& frame)
+    {
+        GLintptr offset = uploadStream(frame.mInstances.data(), sizeof(SpriteInstance) * frame.mInstances.size(), sizeof(float));
+
+        glUseProgram(mInstanceShader);
+        glUniformMatrix4fv(mInstanceMVPLocation, 1, GL_FALSE, glm::value_ptr(mProjection));
+        glBindVertexArray(mInstanceVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer->mVertexBufferID);
 
-        drawTexture(tex, 0, 0, tex->mWidth, tex->mHeight, 1, 1, 0, x, y, 1, 1, 1, 1);
+        const char* base = (const char*)offset;
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mX));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mWidth));
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mAngle));
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mU0));
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mColor));
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_BYTE, sizeof(SpriteInstance), base + offsetof(SpriteInstance, mSlot));
 
+        unsigned int numQuads = frame.mQuadCount;
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numQuads);
+
+        mStats.mDrawCalls++;
+        mStats.mMaxBatchQuads = std::max(mStats.mMaxBatchQuads, numQuads);
+
+        glBindVertexArray(mVAO);
+    }
+
+    void setInstancedSprites(bool enabled)
+    {
+        mNextInstancedSprites = enabled;
+    }
+
+    void setTextureSlots(unsigned int slots)
+    {
+        mNextTextureSlots = std::clamp(slots, 1u, MAX_TEXTURE_SLOTS);
+    }
+
+    // Copies data into the current frame's ring region and returns its byte offset in mVertexBuffer, aligned to stride.
+    GLintptr uploadStream(const void* data, GLsizeiptr numBytes, GLsizeiptr stride)
+    {
         FrameData& frame = getCurrentFrame();
-        frame.mTextTextures.emplace_back(tex);
+
+        GLintptr regionOffset = GLintptr(mFrameNumber % FRAME_OVERLAP) * mStreamRegionBytes;
+        GLintptr offset = (regionOffset + frame.mStreamCursor + stride - 1) / stride * stride;
+
+        if (offset + numBytes > regionOffset + mStreamRegionBytes)
+        {
+            // region exhausted mid-frame, orphan the storage instead of waiting on the GPU
+            mStreamHighWater = std::max(mStreamHighWater, frame.mStreamCursor + numBytes + stride);
+            growStreamRegions(std::max(mStreamRegionBytes, numBytes + stride));
+            frame.mStreamCursor = 0;
+
+            regionOffset = GLintptr(mFrameNumber % FRAME_OVERLAP) * mStreamRegionBytes;
+            offset = (regionOffset + stride - 1) / stride * stride;
+        }
+        SDL_assert_release(offset + numBytes <= regionOffset + mStreamRegionBytes);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer->mVertexBufferID);
+        if (mStreamingVertexBuffer)
+        {
+            void* dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, numBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            SDL_assert_release(dst);
+            memcpy(dst, data, numBytes);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        else
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, offset, numBytes, data);
+        }
+
+        frame.mStreamCursor = offset + numBytes - regionOffset;
+
+        return offset;
+    }
+
+    // Orphans the ring buffer and reallocates it with regions of at least regionBytes.
+    // Draws already submitted keep reading the old storage, so no fence has to be waited on.
+    void growStreamRegions(GLsizeiptr regionBytes)
+    {
+        if (regionBytes > mStreamRegionBytes)
+        {
+            // leave headroom so a slowly growing scene does not reallocate every frame
+            mStreamRegionBytes = (regionBytes + regionBytes / 2 + 4095) / 4096 * 4096;
+            SDL_Log("Vertex stream regions grown to %lld bytes", (long long)mStreamRegionBytes);
+        }
+
+        mVertexBuffer->mNumBytes = mStreamRegionBytes * FRAME_OVERLAP;
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer->mVertexBufferID);
+        glBufferData(GL_ARRAY_BUFFER, mVertexBuffer->mNumBytes, NULL, GL_STREAM_DRAW);
+    }
+
+    void setMaxBatchQuads(size_t quads)
+    {
+        mNextMaxBatchQuads = std::clamp(quads, size_t(1), MAX_QUEUED_COMMANDS);
+    }
+
+    TTF_Font* fontFind(const std::string& path, float ptSize)
+    {
+        std::string key = path + "#" + std::to_string((int)ptSize);
+
+        if (mFonts.contains(key))
+        {
+            return mFonts[key];
+        }
+
+        TTF_Font* font = nullptr;
+        AssetData asset;
+        if (isAssetInPack(path) && loadAsset(path, asset))
+        {
+            // the pack stays mapped for the whole run, so the font can read from it directly
+            font = TTF_OpenFontIO(SDL_IOFromConstMem(asset.mData, asset.mSize), true, ptSize);
+        }
+        else
+        {
+            std::filesystem::path basePath = SDL_GetBasePath();
+            basePath.append("data");
+            basePath.append(path);
+            font = TTF_OpenFont(basePath.generic_string().c_str(), ptSize);
+        }
+
+        if (!font)
+        {
+            SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Font failed to load: %s", SDL_GetError());
+        }
+        else
+        {
+            SDL_Log("Font loaded: %s", path.c_str());
+
+            TTF_Font** slot = mFontPool.allocate();
+            *slot = font;
+            mFontHandles[font] = mFontPool.handleOf(slot);
+
+            auto unloaded = mUnloadedGlyphs.find(key);
+            if (unloaded != mUnloadedGlyphs.end())
+            {
+                mGlyphs[font] = std::move(unloaded->second);
+                mUnloadedGlyphs.erase(unloaded);
+            }
+        }
+
+        mFonts[key] = font;
+
+        return mFonts[key];
+    }
+
+    // Rasterizes the glyph in white the first time it is requested, text color comes from the vertex color.
+    const Glyph& glyphFind(TTF_Font* font, Uint32 codepoint)
+    {
+        int outline = TTF_GetFontOutline(font);
+        uint64_t key = uint64_t(outline) << 32 | codepoint;
+
+        std::unordered_map<uint64_t, Glyph>& glyphs = mGlyphs[font];
+        auto found = glyphs.find(key);
+        if (found != glyphs.end())
+        {
+            return found->second;
+        }
+
+        Glyph& glyph = glyphs[key];
+        glyph = {};
+
+        int minX, maxX, minY, maxY, advance;
+        if (!TTF_GetGlyphMetrics(font, codepoint, &minX, &maxX, &minY, &maxY, &advance))
+        {
+            SDL_Log("%s", SDL_GetError());
+            return glyph;
+        }
+        glyph.mAdvance = advance;
+        // the glyph is rendered like a one character string, shifted right by a negative bearing and the outline
+        glyph.mOffsetX = std::min(minX, 0) - outline;
+
+        // zero width glyphs such as spaces render no surface
+        SDL_Color white = {255, 255, 255, 255};
+        SDL_Surface* surf = TTF_RenderGlyph_Blended(font, codepoint, white);
+        if (!surf)
+        {
+            return glyph;
+        }
+
+        SDL_Surface* rgbaSurf = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_ABGR8888);
+        SDL_DestroySurface(surf);
+        if (!rgbaSurf)
+        {
+            SDL_Log("%s", SDL_GetError());
+            return glyph;
+        }
+
+        // atlas uploads expect tightly packed rows
+        std::vector<unsigned char> pixels(size_t(rgbaSurf->w) * rgbaSurf->h * 4);
+        for (int row = 0; row < rgbaSurf->h; ++row)
+        {
+            memcpy(&pixels[size_t(row) * rgbaSurf->w * 4], (const unsigned char*)rgbaSurf->pixels + size_t(row) * rgbaSurf->pitch, size_t(rgbaSurf->w) * 4);
+        }
+
+        glyph.mTexture = atlasInsert(GLYPH_ATLAS_GROUP, pixels.data(), rgbaSurf->w, rgbaSurf->h, 4);
+        if (!glyph.mTexture)
+        {
+            glyph.mTexture = createTexture(pixels.data(), rgbaSurf->w, rgbaSurf->h, 4);
+        }
+
+        SDL_DestroySurface(rgbaSurf);
+
+        return glyph;
+    }
+
+    // Places the glyphs of text from cached advances and kerning, '\n' starts a new line.
+    // With a wrap width above 0, a line that would grow past it is broken after its last space.
+    // Returns the size of the block, matching TTF_GetStringSizeWrapped.
+    void layoutText(TTF_Font* font, const std::string& text, int wrapWidth, std::vector<PlacedGlyph>& placed, int& outWidth, int& outHeight)
+    {
+        placed.clear();
+
+        int lineSkip = TTF_GetFontLineSkip(font);
+        int width = 0;
+        int penX = 0;
+        int penY = 0;
+        Uint32 previous = 0;
+
+        // first glyph after the last space on the current line, or -1
+        int breakIndex = -1;
+        int breakPenX = 0;
+        int breakLineWidth = 0;
+
+        const char* str = text.c_str();
+        size_t length = text.size();
+        while (length > 0)
+        {
+            Uint32 codepoint = SDL_StepUTF8(&str, &length);
+            if (codepoint == '\r')
+            {
+                continue;
+            }
+            if (codepoint == '\n')
+            {
+                width = std::max(width, penX);
+                penX = 0;
+                penY += lineSkip;
+                previous = 0;
+                breakIndex = -1;
+                continue;
+            }
+
+            int kerning = 0;
+            if (previous && TTF_GetGlyphKerning(font, previous, codepoint, &kerning))
+            {
+                penX += kerning;
+            }
+            previous = codepoint;
+
+            const Glyph& glyph = glyphFind(font, codepoint);
+
+            if (wrapWidth > 0 && breakIndex >= 0 && penX + glyph.mAdvance > wrapWidth)
+            {
+                // move the word after the last space to a new line
+                width = std::max(width, breakLineWidth);
+                penY += lineSkip;
+                for (size_t i = breakIndex; i < placed.size(); ++i)
+                {
+                    placed[i].mX -= breakPenX;
+                    placed[i].mY = float(penY);
+                }
+                penX -= breakPenX;
+                breakIndex = -1;
+            }
+
+            if (glyph.mTexture)
+            {
+                placed.push_back({&glyph, float(penX + glyph.mOffsetX), float(penY)});
+            }
+
+            if (codepoint == ' ')
+            {
+                breakIndex = int(placed.size());
+                breakLineWidth = penX;
+                breakPenX = penX + glyph.mAdvance;
+            }
+            penX += glyph.mAdvance;
+        }
+        width = std::max(width, penX);
+
+        for (const PlacedGlyph& i : placed)
+        {
+            width = std::max(width, int(i.mX) + i.mGlyph->mTexture->mWidth);
+        }
+
+        outWidth = width;
+        outHeight = TTF_GetFontHeight(font) + penY;
+    }
+
+    // the text block is centered on (x, y) like a sprite of its size
+    void drawText(TTF_Font* font, float x, float y, const std::string& text, float r, float g, float b, float a)
+    {
+        int width, height;
+        layoutText(font, text, 0, mPlacedGlyphs, width, height);
+        drawPlacedGlyphs(mPlacedGlyphs, width, height, x, y, r, g, b, a);
+    }
+
+    void drawPlacedGlyphs(const std::vector<PlacedGlyph>& placed, int width, int height, float x, float y, float r, float g, float b, float a)
+    {
+        float left = x - width / 2.0f;
+        float top = y + height / 2.0f;
+
+        mTextSprites.clear();
+        for (const PlacedGlyph& i : placed)
+        {
+            Texture* tex = i.mGlyph->mTexture;
+            float dx = left + i.mX + tex->mWidth / 2.0f;
+            float dy = top - i.mY - tex->mHeight / 2.0f;
+            mTextSprites.push_back({tex, 0, 0, float(tex->mWidth), float(tex->mHeight), 1, 1, 0, dx, dy, r, g, b, a});
+        }
+
+        drawTextures(mTextSprites.data(), mTextSprites.size());
+    }
+
+    // size of the block drawText would draw, glyphs are rasterized but nothing is queued
+    void measureText(TTF_Font* font, const std::string& text, int wrapWidth, int& outWidth, int& outHeight)
+    {
+        layoutText(font, text, wrapWidth, mPlacedGlyphs, outWidth, outHeight);
+    }
+
+    TextObject* createText(TTF_Font* font, const std::string& text, int wrapWidth)
+    {
+        TextObject* obj = mTextPool.allocate();
+        retainFont(font);
+        obj->mFont = font;
+        obj->mText = text;
+        obj->mWrapWidth = wrapWidth;
+        layoutTextObject(obj);
+        return obj;
+    }
+
+    void updateText(TextObject* obj, const std::string& text, int wrapWidth)
+    {
+        if (obj->mText == text && obj->mWrapWidth == wrapWidth)
+        {
+            return;
+        }
+        obj->mText = text;
+        obj->mWrapWidth = wrapWidth;
+        layoutTextObject(obj);
+    }
+
+    void layoutTextObject(TextObject* obj)
+    {
+        obj->mOutline = TTF_GetFontOutline(obj->mFont);
+        layoutText(obj->mFont, obj->mText, obj->mWrapWidth, obj->mGlyphs, obj->mWidth, obj->mHeight);
+    }
+
+    void drawTextObject(TextObject* obj, float x, float y, float r, float g, float b, float a)
+    {
+        // the outline is font state, a change since the last layout needs other glyphs
+        if (obj->mOutline != TTF_GetFontOutline(obj->mFont))
+        {
+            layoutTextObject(obj);
+        }
+        drawPlacedGlyphs(obj->mGlyphs, obj->mWidth, obj->mHeight, x, y, r, g, b, a);
+    }
+
+    void destroyText(TextObject* obj)
+    {
+        releaseFont(obj->mFont);
+        mTextPool.release(obj);
     }
 };
 
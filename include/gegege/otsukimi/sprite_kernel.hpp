@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gegege::otsukimi {
+
+struct Texture;
+struct Vertex;
+
+struct SpriteDesc {
+    Texture* mTexture;
+    float mSX;
+    float mSY;
+    float mSW;
+    float mSH;
+    float mScaleX;
+    float mScaleY;
+    float mAngle;
+    float mDX;
+    float mDY;
+    float mR;
+    float mG;
+    float mB;
+    float mA;
+};
+
+// Writes the positions of 4 vertices per sprite in top-left, bottom-left, bottom-right, top-right order.
+// Uses AVX2 or SSE2 when the CPU has them and a scalar loop otherwise, all variants produce the same bits.
+void transformSprites(const SpriteDesc* sprites, size_t count, Vertex* vertices);
+
+} // namespace gegege::otsukimi
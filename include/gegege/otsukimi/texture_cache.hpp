@@ -0,0 +1,154 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include <stb_image.h>
+
+namespace gegege::otsukimi {
+
+// Cooked textures are a CookedTextureHeader followed by tightly packed RGB8 or RGBA8 rows.
+// With mMipCount above 1 each smaller level follows the previous one.
+constexpr char COOKED_TEXTURE_MAGIC[4] = {'O', 'T', 'K', 'T'};
+constexpr uint32_t COOKED_TEXTURE_VERSION = 1;
+constexpr const char* COOKED_TEXTURE_EXTENSION = ".otkt";
+
+// color channels are already multiplied by alpha.
+// Not written yet, the sprite blend state expects straight alpha, so such files are decoded from source instead.
+constexpr uint32_t COOKED_TEXTURE_PREMULTIPLIED = 1 << 0;
+
+struct CookedTextureHeader {
+    char mMagic[4];
+    uint32_t mVersion;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mChannels;
+    uint32_t mFlags;
+    uint32_t mMipCount;
+    uint32_t mPadding;
+    // the source image the file was cooked from, a mismatch means it is stale
+    int64_t mSourceTime;
+    uint64_t mSourceSize;
+};
+
+// Pixels of a loaded image, either decoded by stb_image or viewed inside a mapped cooked file.
+struct Image {
+    const unsigned char* mPixels = nullptr;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mChannels = 0;
+    unsigned char* mDecoded = nullptr;
+    MappedFile mMapped;
+};
+
+inline void freeImage(Image& image)
+{
+    stbi_image_free(image.mDecoded);
+    unmapFile(image.mMapped);
+    image = {};
+}
+
+// Where the cooked copy of the texture at path lives inside cacheRoot.
+// Fails for absolute paths and paths that climb out with "..", their cooked files would land outside the cache.
+inline bool getCookedTexturePath(const std::filesystem::path& cacheRoot, const std::string& path, std::filesystem::path& cookedPath)
+{
+    std::filesystem::path relative = std::filesystem::path(path).lexically_normal();
+    if (relative.empty() || relative.has_root_name() || relative.has_root_directory() || *relative.begin() == "..")
+    {
+        return false;
+    }
+
+    relative += COOKED_TEXTURE_EXTENSION;
+    cookedPath = cacheRoot / relative;
+    return true;
+}
+
+// Maps a cooked texture and points image at its level 0 pixels.
+// Fails when the file is missing, malformed or was cooked from a different version of the source.
+inline bool readCookedTexture(const std::filesystem::path& path, int64_t sourceTime, uint64_t sourceSize, Image& image)
+{
+    MappedFile file;
+    if (!mapFile(path, file))
+    {
+        return false;
+    }
+
+    CookedTextureHeader header;
+    bool valid = file.mSize >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, file.mData, sizeof(header));
+        valid = memcmp(header.mMagic, COOKED_TEXTURE_MAGIC, 4) == 0 &&
+                header.mVersion == COOKED_TEXTURE_VERSION &&
+                header.mSourceTime == sourceTime &&
+                header.mSourceSize == sourceSize &&
+                (header.mChannels == 3 || header.mChannels == 4) &&
+                !(header.mFlags & COOKED_TEXTURE_PREMULTIPLIED) &&
+                file.mSize - sizeof(header) >= uint64_t(header.mWidth) * header.mHeight * header.mChannels;
+    }
+
+    if (!valid)
+    {
+        unmapFile(file);
+        return false;
+    }
+
+    image.mPixels = file.mData + sizeof(header);
+    image.mWidth = int(header.mWidth);
+    image.mHeight = int(header.mHeight);
+    image.mChannels = int(header.mChannels);
+    image.mMapped = file;
+    return true;
+}
+
+inline bool writeCookedTexture(const std::filesystem::path& path, const Image& image, int64_t sourceTime, uint64_t sourceSize)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    CookedTextureHeader header = {};
+    memcpy(header.mMagic, COOKED_TEXTURE_MAGIC, 4);
+    header.mVersion = COOKED_TEXTURE_VERSION;
+    header.mWidth = uint32_t(image.mWidth);
+    header.mHeight = uint32_t(image.mHeight);
+    header.mChannels = uint32_t(image.mChannels);
+    header.mMipCount = 1;
+    header.mSourceTime = sourceTime;
+    header.mSourceSize = sourceSize;
+
+    // written under a temporary name first so a crash never leaves a truncated file that passes the header check
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+
+    SDL_IOStream* io = SDL_IOFromFile(tempPath.generic_string().c_str(), "wb");
+    if (!io)
+    {
+        SDL_Log("Cooked texture failed to write: %s", SDL_GetError());
+        return false;
+    }
+
+    size_t numBytes = size_t(image.mWidth) * image.mHeight * image.mChannels;
+    bool written = SDL_WriteIO(io, &header, sizeof(header)) == sizeof(header) &&
+                   SDL_WriteIO(io, image.mPixels, numBytes) == numBytes;
+    written = SDL_CloseIO(io) && written;
+
+    if (written)
+    {
+        std::filesystem::rename(tempPath, path, ec);
+        written = !ec;
+    }
+    if (!written)
+    {
+        std::filesystem::remove(tempPath, ec);
+        SDL_Log("Cooked texture failed to write: %s", path.generic_string().c_str());
+    }
+    return written;
+}
+
+} // namespace gegege::otsukimi
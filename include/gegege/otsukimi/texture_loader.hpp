@@ -0,0 +1,125 @@
+#pragma once
+
+#include "texture_cache.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+struct DecodedImage {
+    std::string mPath;
+    // mPixels is nullptr when the image failed to load
+    Image mImage;
+};
+
+// Reads and decodes images on a small pool of worker threads.
+// Finished images are collected with poll on the GL thread, which does the upload.
+struct TextureLoader {
+    using DecodeFunc = std::function<bool(const std::string& path, Image& image)>;
+
+    DecodeFunc mDecode;
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<std::string> mRequests;
+    std::deque<DecodedImage> mResults;
+    bool mStopping = false;
+
+    void startup(DecodeFunc decode, unsigned int numWorkers)
+    {
+        mDecode = decode;
+        mStopping = false;
+        for (unsigned int i = 0; i < numWorkers; ++i)
+        {
+            mWorkers.emplace_back([this] { workerMain(); });
+        }
+    }
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+            mRequests.clear();
+        }
+        mWake.notify_all();
+
+        for (std::thread& i : mWorkers)
+        {
+            i.join();
+        }
+        mWorkers.clear();
+
+        for (DecodedImage& i : mResults)
+        {
+            freeImage(i.mImage);
+        }
+        mResults.clear();
+    }
+
+    bool isRunning() const
+    {
+        return !mWorkers.empty();
+    }
+
+    void request(const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRequests.push_back(path);
+        }
+        mWake.notify_one();
+    }
+
+    // takes one finished image, returns false when none is ready
+    bool poll(DecodedImage& out)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mResults.empty())
+        {
+            return false;
+        }
+        out = std::move(mResults.front());
+        mResults.pop_front();
+        return true;
+    }
+
+    void workerMain()
+    {
+        for (;;)
+        {
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWake.wait(lock, [this] { return mStopping || !mRequests.empty(); });
+                if (mStopping)
+                {
+                    return;
+                }
+                path = std::move(mRequests.front());
+                mRequests.pop_front();
+            }
+
+            DecodedImage decoded;
+            decoded.mPath = path;
+            mDecode(path, decoded.mImage);
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mStopping)
+            {
+                freeImage(decoded.mImage);
+                return;
+            }
+            mResults.push_back(std::move(decoded));
+        }
+    }
+};
+
+} // namespace gegege::otsukimi
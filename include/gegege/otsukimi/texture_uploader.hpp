@@ -0,0 +1,133 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "gl.h"
+
+#include <cstring>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+// uploads smaller than this are copied straight from client memory, a fenced buffer would cost more than it saves
+constexpr size_t PBO_MIN_UPLOAD_BYTES = 16 * 1024;
+// pixel buffers kept for reuse, once all are in flight the oldest one is orphaned instead of waited on
+constexpr size_t PBO_MAX_BUFFERS = 16;
+
+struct PixelBuffer {
+    GLuint mBufferID;
+    GLsizeiptr mNumBytes;
+    // signalled once the GPU has finished reading the last upload staged in this buffer
+    GLsync mFence;
+};
+
+// Stages texel data in pixel unpack buffers so glTexSubImage2D returns without waiting for the copy.
+// Buffers are recycled once their fence has signalled.
+struct TextureUploader {
+    std::vector<PixelBuffer> mBuffers;
+    size_t mNextOrphan = 0;
+
+    void shutdown()
+    {
+        for (PixelBuffer& i : mBuffers)
+        {
+            if (i.mFence)
+            {
+                glDeleteSync(i.mFence);
+            }
+            glDeleteBuffers(1, &i.mBufferID);
+        }
+        mBuffers.clear();
+    }
+
+    // data holds height tightly packed rows of width texels in format
+    void texSubImage(GLuint texID, int x, int y, int width, int height, GLenum format, const void* data)
+    {
+        size_t numBytes = size_t(width) * height * (format == GL_RGBA ? 4 : 3);
+
+        glBindTexture(GL_TEXTURE_2D, texID);
+
+        if (numBytes < PBO_MIN_UPLOAD_BYTES)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, GL_UNSIGNED_BYTE, data);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return;
+        }
+
+        PixelBuffer& buffer = acquireBuffer(GLsizeiptr(numBytes));
+
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, numBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        SDL_assert_release(dst);
+        memcpy(dst, data, numBytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, GL_UNSIGNED_BYTE, 0);
+        buffer.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Returns an idle buffer of at least numBytes, bound to GL_PIXEL_UNPACK_BUFFER.
+    PixelBuffer& acquireBuffer(GLsizeiptr numBytes)
+    {
+        // smallest idle buffer that fits, otherwise any idle buffer, which is then grown
+        PixelBuffer* fit = nullptr;
+        PixelBuffer* idle = nullptr;
+        for (PixelBuffer& i : mBuffers)
+        {
+            if (!isIdle(i))
+            {
+                continue;
+            }
+            idle = &i;
+            if (i.mNumBytes >= numBytes && (!fit || i.mNumBytes < fit->mNumBytes))
+            {
+                fit = &i;
+            }
+        }
+        PixelBuffer* found = fit ? fit : idle;
+
+        if (!found && mBuffers.size() < PBO_MAX_BUFFERS)
+        {
+            found = &mBuffers.emplace_back();
+            glGenBuffers(1, &found->mBufferID);
+            found->mNumBytes = 0;
+            found->mFence = nullptr;
+        }
+
+        if (!found)
+        {
+            // every buffer is still being read, orphan one so the driver hands out fresh storage
+            found = &mBuffers[mNextOrphan++ % mBuffers.size()];
+            found->mNumBytes = 0;
+        }
+
+        if (found->mFence)
+        {
+            glDeleteSync(found->mFence);
+            found->mFence = nullptr;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, found->mBufferID);
+        if (found->mNumBytes < numBytes)
+        {
+            found->mNumBytes = numBytes;
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, numBytes, NULL, GL_STREAM_DRAW);
+        }
+
+        return *found;
+    }
+
+    bool isIdle(const PixelBuffer& buffer)
+    {
+        if (!buffer.mFence)
+        {
+            return true;
+        }
+        GLenum result = glClientWaitSync(buffer.mFence, 0, 0);
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+};
+
+} // namespace gegege::otsukimi
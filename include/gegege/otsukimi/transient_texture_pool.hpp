@@ -0,0 +1,149 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "gl.h"
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+// free textures unused for this many frames are deleted
+constexpr uint32_t TRANSIENT_TEXTURE_MAX_IDLE_FRAMES = 120;
+
+struct RetiredTexture {
+    GLuint mTexID;
+    // first frame in which the GPU is done with the texture
+    uint32_t mReusableFrame;
+};
+
+struct IdleTexture {
+    GLuint mTexID;
+    uint32_t mIdleSince;
+};
+
+// Keeps the GL textures of deleted Textures for reuse by new ones of the same size and format,
+// so textures that come and go every few frames skip glGenTextures and storage allocation.
+// A released texture may still be read by frames in flight, it only becomes reusable
+// once those have finished, so rewriting it never makes the driver wait or copy.
+struct TransientTexturePool {
+    // bucket key of every texture the pool created and has not deleted
+    std::unordered_map<GLuint, uint64_t> mKeys;
+    std::deque<RetiredTexture> mRetired;
+    std::unordered_map<uint64_t, std::vector<IdleTexture>> mIdle;
+    size_t mIdleBytes = 0;
+
+    static uint64_t bucketKey(int width, int height, GLenum internalFormat)
+    {
+        return uint64_t(internalFormat) << 40 | uint64_t(width) << 20 | uint64_t(height);
+    }
+
+    static size_t bucketBytes(uint64_t key)
+    {
+        // RGB8 is padded to four bytes per texel, as in textureBytes
+        return size_t((key >> 20) & 0xFFFFF) * size_t(key & 0xFFFFF) * 4;
+    }
+
+    // Returns a texture with uninitialized level 0 storage, bound to nothing.
+    // Sampler state is whatever the previous user left, the caller sets its own.
+    GLuint acquire(int width, int height, GLenum internalFormat)
+    {
+        uint64_t key = bucketKey(width, height, internalFormat);
+
+        auto bucket = mIdle.find(key);
+        if (bucket != mIdle.end() && !bucket->second.empty())
+        {
+            GLuint texID = bucket->second.back().mTexID;
+            bucket->second.pop_back();
+            mIdleBytes -= bucketBytes(key);
+            return texID;
+        }
+
+        GLuint texID = 0;
+        glGenTextures(1, &texID);
+        SDL_assert_release(texID);
+        glBindTexture(GL_TEXTURE_2D, texID);
+        GLenum format = internalFormat == GL_RGB8 ? GL_RGB : GL_RGBA;
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        mKeys[texID] = key;
+        return texID;
+    }
+
+    // Hands the texture back for reuse from reusableFrame on.
+    // Textures the pool did not create are deleted.
+    void release(GLuint texID, uint32_t reusableFrame)
+    {
+        if (!mKeys.contains(texID))
+        {
+            glDeleteTextures(1, &texID);
+            return;
+        }
+        mRetired.push_back({texID, reusableFrame});
+    }
+
+    // deletes the texture right away, for storage that should not be kept around
+    void destroy(GLuint texID)
+    {
+        mKeys.erase(texID);
+        glDeleteTextures(1, &texID);
+    }
+
+    // makes retired textures reusable and deletes the ones idle for too long, called once per frame
+    void update(uint32_t frameNumber)
+    {
+        while (!mRetired.empty() && mRetired.front().mReusableFrame <= frameNumber)
+        {
+            RetiredTexture retired = mRetired.front();
+            mRetired.pop_front();
+
+            uint64_t key = mKeys[retired.mTexID];
+            mIdle[key].push_back({retired.mTexID, frameNumber});
+            mIdleBytes += bucketBytes(key);
+        }
+
+        for (auto& [key, bucket] : mIdle)
+        {
+            // the oldest entries are at the front, acquire takes from the back
+            size_t expired = 0;
+            while (expired < bucket.size() && bucket[expired].mIdleSince + TRANSIENT_TEXTURE_MAX_IDLE_FRAMES <= frameNumber)
+            {
+                destroy(bucket[expired].mTexID);
+                mIdleBytes -= bucketBytes(key);
+                ++expired;
+            }
+            bucket.erase(bucket.begin(), bucket.begin() + expired);
+        }
+    }
+
+    // deletes every idle texture, retired ones are still in use and stay
+    void trim()
+    {
+        for (auto& [key, bucket] : mIdle)
+        {
+            for (IdleTexture& i : bucket)
+            {
+                destroy(i.mTexID);
+            }
+        }
+        mIdle.clear();
+        mIdleBytes = 0;
+    }
+
+    void shutdown()
+    {
+        trim();
+        for (RetiredTexture& i : mRetired)
+        {
+            destroy(i.mTexID);
+        }
+        mRetired.clear();
+        mKeys.clear();
+    }
+};
+
+} // namespace gegege::otsukimi
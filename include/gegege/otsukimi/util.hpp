@@ -1,9 +1,28 @@
 #pragma once
 
+#include "frame_pacer.hpp"
+
 namespace gegege::otsukimi {
 
 int getMouseCoordinateToScreenCoordinateX(int mouseX);
 
 int getMouseCoordinateToScreenCoordinateY(int mouseY);
 
+// Runs onFixedUpdate this many times per second, 0 turns it off.
+void setTickRate(double ticksPerSecond);
+
+void setMaxCatchUpTicks(int ticks);
+
+float getInterpolationAlpha();
+
+void setPacingMode(PacingMode mode);
+
+// frames per second in PacingMode::Limited
+void setFrameRateLimit(double fps);
+
+// After each present, waits until fewer than this many presented frames are unfinished on the GPU, 0 turns it off.
+void setMaxQueuedFrames(unsigned int frames);
+
+PacingStats getPacingStats();
+
 }
@@ -0,0 +1,309 @@
+#include "../../../include/gegege/otsukimi/asset_pack.hpp"
+
+#include "../../../include/gegege/otsukimi/mapped_file.hpp"
+
+#include <SDL3/SDL.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace gegege::otsukimi {
+
+namespace {
+
+// A pack is a PackHeader, mEntryCount PackEntry records sorted by hash then name,
+// the entry names, then the asset bytes, each starting on a 16 byte boundary.
+constexpr char PACK_MAGIC[4] = {'O', 'T', 'P', 'K'};
+constexpr uint32_t PACK_VERSION = 1;
+constexpr uint64_t PACK_DATA_ALIGNMENT = 16;
+
+struct PackHeader {
+    char mMagic[4];
+    uint32_t mVersion;
+    uint32_t mEntryCount;
+    uint32_t mPadding;
+};
+
+struct PackEntry {
+    uint64_t mHash;
+    uint64_t mOffset;
+    uint64_t mSize;
+    uint32_t mNameOffset;
+    uint32_t mNameLength;
+};
+
+struct AssetPack {
+    MappedFile mFile;
+    const PackEntry* mEntries = nullptr;
+    uint32_t mEntryCount = 0;
+    int64_t mTime = 0;
+};
+
+AssetPack sAssetPack;
+
+std::filesystem::path getLoosePath(const std::string& path)
+{
+    std::filesystem::path loosePath = SDL_GetBasePath();
+    loosePath.append("data");
+    loosePath.append(path);
+    return loosePath;
+}
+
+// Every name and asset lies inside the file, each entry's hash matches its name,
+// and the hashes ascend as the binary search in findEntry expects.
+bool validateEntries(const MappedFile& file, const PackEntry* entries, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const PackEntry& entry = entries[i];
+        if (uint64_t(entry.mNameOffset) + entry.mNameLength > file.mSize || entry.mOffset > file.mSize || entry.mSize > file.mSize - entry.mOffset)
+        {
+            return false;
+        }
+
+        std::string_view name((const char*)file.mData + entry.mNameOffset, entry.mNameLength);
+        if (entry.mHash != hashAssetPath(name) || (i > 0 && entries[i - 1].mHash > entry.mHash))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const PackEntry* findEntry(const std::string& path)
+{
+    if (!sAssetPack.mEntries)
+    {
+        return nullptr;
+    }
+
+    uint64_t hash = hashAssetPath(path);
+    const PackEntry* end = sAssetPack.mEntries + sAssetPack.mEntryCount;
+    const PackEntry* entry = std::lower_bound(sAssetPack.mEntries, end, hash, [](const PackEntry& e, uint64_t h) { return e.mHash < h; });
+
+    // colliding hashes sit next to each other, the stored name decides
+    for (; entry != end && entry->mHash == hash; ++entry)
+    {
+        const char* name = (const char*)sAssetPack.mFile.mData + entry->mNameOffset;
+        if (entry->mNameLength == path.size() && memcmp(name, path.data(), path.size()) == 0)
+        {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+// 64-bit FNV-1a
+uint64_t hashAssetPath(std::string_view path)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : path)
+    {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool mountAssetPack(const std::filesystem::path& packPath)
+{
+    unmountAssetPack();
+
+    MappedFile file;
+    if (!mapFile(packPath, file))
+    {
+        return false;
+    }
+
+    PackHeader header;
+    bool valid = file.mSize >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, file.mData, sizeof(header));
+        valid = memcmp(header.mMagic, PACK_MAGIC, 4) == 0 && header.mVersion == PACK_VERSION &&
+                file.mSize >= sizeof(header) + uint64_t(header.mEntryCount) * sizeof(PackEntry) &&
+                validateEntries(file, (const PackEntry*)(file.mData + sizeof(header)), header.mEntryCount);
+    }
+    if (!valid)
+    {
+        SDL_Log("Asset pack is invalid: %s", packPath.generic_string().c_str());
+        unmapFile(file);
+        return false;
+    }
+
+    std::error_code ec;
+    sAssetPack.mFile = file;
+    sAssetPack.mEntries = (const PackEntry*)(file.mData + sizeof(header));
+    sAssetPack.mEntryCount = header.mEntryCount;
+    sAssetPack.mTime = std::filesystem::last_write_time(packPath, ec).time_since_epoch().count();
+
+    SDL_Log("Asset pack mounted: %s %u assets", packPath.generic_string().c_str(), header.mEntryCount);
+    return true;
+}
+
+void unmountAssetPack()
+{
+    unmapFile(sAssetPack.mFile);
+    sAssetPack = {};
+}
+
+bool isAssetInPack(const std::string& path)
+{
+    return findEntry(path) != nullptr;
+}
+
+bool loadAsset(const std::string& path, AssetData& asset)
+{
+    asset = {};
+
+    const PackEntry* entry = findEntry(path);
+    if (entry)
+    {
+        asset.mData = sAssetPack.mFile.mData + entry->mOffset;
+        asset.mSize = size_t(entry->mSize);
+        return true;
+    }
+
+    size_t size;
+    void* data = SDL_LoadFile(getLoosePath(path).generic_string().c_str(), &size);
+    if (!data)
+    {
+        return false;
+    }
+    asset.mData = (const unsigned char*)data;
+    asset.mSize = size;
+    asset.mOwned = data;
+    return true;
+}
+
+void freeAsset(AssetData& asset)
+{
+    SDL_free(asset.mOwned);
+    asset = {};
+}
+
+bool statAsset(const std::string& path, int64_t& time, uint64_t& size)
+{
+    const PackEntry* entry = findEntry(path);
+    if (entry)
+    {
+        time = sAssetPack.mTime;
+        size = entry->mSize;
+        return true;
+    }
+
+    std::filesystem::path loosePath = getLoosePath(path);
+    std::error_code timeError, sizeError;
+    auto looseTime = std::filesystem::last_write_time(loosePath, timeError);
+    size = std::filesystem::file_size(loosePath, sizeError);
+    if (timeError || sizeError)
+    {
+        return false;
+    }
+    time = looseTime.time_since_epoch().count();
+    return true;
+}
+
+bool writeAssetPack(const std::filesystem::path& dataDir, const std::filesystem::path& packPath)
+{
+    struct Source {
+        std::string mName;
+        std::filesystem::path mPath;
+        uint64_t mSize;
+    };
+
+    std::vector<Source> sources;
+    std::error_code ec;
+    for (const auto& i : std::filesystem::recursive_directory_iterator(dataDir, ec))
+    {
+        if (i.is_regular_file())
+        {
+            sources.push_back({std::filesystem::relative(i.path(), dataDir).generic_string(), i.path(), i.file_size()});
+        }
+    }
+    if (ec)
+    {
+        SDL_Log("Asset pack: can't read %s", dataDir.generic_string().c_str());
+        return false;
+    }
+
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) {
+        uint64_t hashA = hashAssetPath(a.mName);
+        uint64_t hashB = hashAssetPath(b.mName);
+        return hashA != hashB ? hashA < hashB : a.mName < b.mName;
+    });
+
+    PackHeader header = {};
+    memcpy(header.mMagic, PACK_MAGIC, 4);
+    header.mVersion = PACK_VERSION;
+    header.mEntryCount = uint32_t(sources.size());
+
+    std::vector<PackEntry> entries(sources.size());
+    std::string names;
+    uint64_t namesOffset = sizeof(header) + entries.size() * sizeof(PackEntry);
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        entries[i].mHash = hashAssetPath(sources[i].mName);
+        entries[i].mNameOffset = uint32_t(namesOffset + names.size());
+        entries[i].mNameLength = uint32_t(sources[i].mName.size());
+        names += sources[i].mName;
+    }
+
+    uint64_t offset = namesOffset + names.size();
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        offset = (offset + PACK_DATA_ALIGNMENT - 1) / PACK_DATA_ALIGNMENT * PACK_DATA_ALIGNMENT;
+        entries[i].mOffset = offset;
+        entries[i].mSize = sources[i].mSize;
+        offset += sources[i].mSize;
+    }
+
+    SDL_IOStream* io = SDL_IOFromFile(packPath.generic_string().c_str(), "wb");
+    if (!io)
+    {
+        SDL_Log("Asset pack: %s", SDL_GetError());
+        return false;
+    }
+
+    bool written = SDL_WriteIO(io, &header, sizeof(header)) == sizeof(header) &&
+                   SDL_WriteIO(io, entries.data(), entries.size() * sizeof(PackEntry)) == entries.size() * sizeof(PackEntry) &&
+                   SDL_WriteIO(io, names.data(), names.size()) == names.size();
+
+    uint64_t position = namesOffset + names.size();
+    const unsigned char zeros[PACK_DATA_ALIGNMENT] = {};
+    for (size_t i = 0; written && i < sources.size(); ++i)
+    {
+        size_t padding = size_t(entries[i].mOffset - position);
+        written = SDL_WriteIO(io, zeros, padding) == padding;
+
+        size_t size;
+        void* data = SDL_LoadFile(sources[i].mPath.generic_string().c_str(), &size);
+        if (!data || size != entries[i].mSize)
+        {
+            SDL_Log("Asset pack: can't read %s", sources[i].mPath.generic_string().c_str());
+            written = false;
+        }
+        else
+        {
+            written = written && SDL_WriteIO(io, data, size) == size;
+        }
+        SDL_free(data);
+
+        position = entries[i].mOffset + entries[i].mSize;
+    }
+
+    written = SDL_CloseIO(io) && written;
+    if (!written)
+    {
+        SDL_Log("Asset pack: failed to write %s", packPath.generic_string().c_str());
+        return false;
+    }
+
+    SDL_Log("Asset pack written: %s %u assets", packPath.generic_string().c_str(), header.mEntryCount);
+    return true;
+}
+
+} // namespace gegege::otsukimi
@@ -29,9 +29,99 @@ void setScreenHeight(int height)
     SDL_SetWindowSize(gRenderer->mSdlWindow, w, height);
 }
 
-Texture* textureFind(const std::string& path)
+void setDirectRendering(bool enabled)
 {
-    return gRenderer->textureFind(path);
+    gRenderer->setDirectRendering(enabled);
+}
+
+void setRedrawOnDemand(bool enabled)
+{
+    gRenderer->setRedrawOnDemand(enabled);
+}
+
+void setMinFrameRate(float fps)
+{
+    gRenderer->setMinFrameRate(fps);
+}
+
+void requestRedraw()
+{
+    gRenderer->requestRedraw();
+}
+
+Texture* textureFind(const std::string& path, bool pin)
+{
+    Texture* tex = gRenderer->textureFind(path);
+    if (pin)
+    {
+        gRenderer->pinTexture(tex);
+    }
+    return tex;
+}
+
+Texture* textureFindAsync(const std::string& path, bool pin)
+{
+    Texture* tex = gRenderer->textureFindAsync(path);
+    if (pin)
+    {
+        gRenderer->pinTexture(tex);
+    }
+    return tex;
+}
+
+bool isTextureLoaded(Texture* tex)
+{
+    return gRenderer->isTextureLoaded(tex);
+}
+
+void setTextureUploadBudget(size_t bytes)
+{
+    gRenderer->setTextureUploadBudget(bytes);
+}
+
+Texture* createDynamicTexture(int width, int height, bool pin)
+{
+    Texture* tex = gRenderer->createDynamicTexture(width, height);
+    if (pin)
+    {
+        gRenderer->pinTexture(tex);
+    }
+    return tex;
+}
+
+void updateDynamicTexture(Texture* tex, const unsigned char* pixels)
+{
+    gRenderer->updateDynamicTexture(tex, pixels);
+}
+
+void setTextureFilter(Texture* tex, bool linear, bool mipmaps)
+{
+    gRenderer->setTextureFilter(tex, linear, mipmaps);
+}
+
+void setTextureMipmapsOnLoad(bool enabled)
+{
+    gRenderer->setTextureMipmapsOnLoad(enabled);
+}
+
+void setTextureBudget(size_t bytes)
+{
+    gRenderer->setTextureBudget(bytes);
+}
+
+TextureStats getTextureStats()
+{
+    return gRenderer->getTextureStats();
+}
+
+void setTextureAtlasEnabled(bool enabled)
+{
+    gRenderer->mAtlasEnabled = enabled;
+}
+
+void textureAtlasGroup(const std::string& group, const std::vector<std::string>& paths)
+{
+    gRenderer->textureAtlasGroup(group, paths);
 }
 
 int getTextureWidth(Texture* tex)
@@ -44,14 +134,29 @@ int getTextureHeight(Texture* tex)
     return tex->mHeight;
 }
 
-void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a)
+void drawTexture(Texture* tex, float sx, float sy, float sw, float sh, float scaleX, float scaleY, float angle, float dx, float dy, float r, float g, float b, float a, int layer)
+{
+    gRenderer->drawTexture(tex, sx, sy, sw, sh, scaleX, scaleY, angle, dx, dy, r, g, b, a, layer);
+}
+
+void drawTextures(const SpriteDesc* sprites, size_t count, int layer)
+{
+    gRenderer->drawTextures(sprites, count, layer);
+}
+
+void setLayerReorder(int layer, bool enabled)
 {
-    gRenderer->drawTexture(tex, sx, sy, sw, sh, scaleX, scaleY, angle, dx, dy, r, g, b, a);
+    gRenderer->setLayerReorder(layer, enabled);
 }
 
-TTF_Font* fontFind(const std::string& path, float ptSize)
+TTF_Font* fontFind(const std::string& path, float ptSize, bool pin)
 {
-    return gRenderer->fontFind(path, ptSize);
+    TTF_Font* font = gRenderer->fontFind(path, ptSize);
+    if (pin)
+    {
+        gRenderer->pinFont(font);
+    }
+    return font;
 }
 
 void drawText(TTF_Font* font, float x, float y, const std::string& text, float r, float g, float b, float a)
@@ -64,4 +169,109 @@ void setFontOutline(TTF_Font* font, int outline)
     TTF_SetFontOutline(font, outline);
 }
 
+void measureText(TTF_Font* font, const std::string& text, int wrapWidth, int& outWidth, int& outHeight)
+{
+    gRenderer->measureText(font, text, wrapWidth, outWidth, outHeight);
+}
+
+TextObject* createText(TTF_Font* font, const std::string& text, int wrapWidth)
+{
+    return gRenderer->createText(font, text, wrapWidth);
+}
+
+void updateText(TextObject* obj, const std::string& text, int wrapWidth)
+{
+    gRenderer->updateText(obj, text, wrapWidth);
+}
+
+void drawTextObject(TextObject* obj, float x, float y, float r, float g, float b, float a)
+{
+    gRenderer->drawTextObject(obj, x, y, r, g, b, a);
+}
+
+int getTextObjectWidth(TextObject* obj)
+{
+    return obj->mWidth;
+}
+
+int getTextObjectHeight(TextObject* obj)
+{
+    return obj->mHeight;
+}
+
+void destroyText(TextObject* obj)
+{
+    gRenderer->destroyText(obj);
+}
+
+RenderStats getRenderStats()
+{
+    return gRenderer->mLastStats;
+}
+
+void setInstancedSprites(bool enabled)
+{
+    gRenderer->setInstancedSprites(enabled);
+}
+
+void setMaxBatchQuads(size_t quads)
+{
+    gRenderer->setMaxBatchQuads(quads);
+}
+
+void setTextureSlots(unsigned int slots)
+{
+    gRenderer->setTextureSlots(slots);
+}
+
+Handle getTextureHandle(Texture* tex)
+{
+    return gRenderer->getTextureHandle(tex);
+}
+
+Texture* resolveTexture(Handle handle)
+{
+    return gRenderer->resolveTexture(handle);
+}
+
+Handle getFontHandle(TTF_Font* font)
+{
+    return gRenderer->getFontHandle(font);
+}
+
+TTF_Font* resolveFont(Handle handle)
+{
+    return gRenderer->resolveFont(handle);
+}
+
+Handle getTextHandle(TextObject* obj)
+{
+    return gRenderer->getTextHandle(obj);
+}
+
+TextObject* resolveText(Handle handle)
+{
+    return gRenderer->resolveText(handle);
+}
+
+void retainTexture(Texture* tex)
+{
+    gRenderer->retainTexture(tex);
+}
+
+void releaseTexture(Texture* tex)
+{
+    gRenderer->releaseTexture(tex);
+}
+
+void retainFont(TTF_Font* font)
+{
+    gRenderer->retainFont(font);
+}
+
+void releaseFont(TTF_Font* font)
+{
+    gRenderer->releaseFont(font);
+}
+
 } // namespace gegege::otsukimi
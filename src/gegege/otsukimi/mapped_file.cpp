@@ -0,0 +1,111 @@
+#include "../../../include/gegege/otsukimi/mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gegege::otsukimi {
+
+#ifdef _WIN32
+
+bool mapFile(const std::filesystem::path& path, MappedFile& file)
+{
+    file = {};
+
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.mData = (const unsigned char*)data;
+    file.mSize = size_t(size.QuadPart);
+    file.mFile = handle;
+    file.mMapping = mapping;
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if (file.mData)
+    {
+        UnmapViewOfFile(file.mData);
+        CloseHandle((HANDLE)file.mMapping);
+        CloseHandle((HANDLE)file.mFile);
+    }
+    file = {};
+}
+
+#else
+
+bool mapFile(const std::filesystem::path& path, MappedFile& file)
+{
+    file = {};
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    file.mData = (const unsigned char*)data;
+    file.mSize = size_t(st.st_size);
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if (file.mData)
+    {
+        munmap((void*)file.mData, file.mSize);
+    }
+    file = {};
+}
+
+#endif
+
+} // namespace gegege::otsukimi
@@ -9,6 +9,7 @@
 namespace gegege::otsukimi {
 
 Renderer* gRenderer;
+Otsukimi* gOtsukimi;
 
 void Otsukimi::startup()
 {
@@ -19,6 +20,11 @@ void Otsukimi::startup()
 
     mFullscreen = false;
 
+    // data.pak next to the executable replaces the loose files it contains
+    std::filesystem::path packPath = SDL_GetBasePath();
+    packPath.append("data.pak");
+    mountAssetPack(packPath);
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
@@ -40,21 +46,14 @@ void Otsukimi::startup()
     SDL_Log("OpenGL Renderer: %s", (const char*)glGetString(GL_RENDERER));
     SDL_Log("GLSL Version: %s", (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
 
-    // set VSYNC
-    if (!SDL_GL_SetSwapInterval(-1))
-    {
-        SDL_Log("VSYNC: %s", SDL_GetError());
-        if (!SDL_GL_SetSwapInterval(1))
-        {
-            SDL_Log("VSYNC: %s", SDL_GetError());
-        }
-    }
+    mFramePacer.setMode(PacingMode::Adaptive);
 
     mRenderer.mSdlWindow = mSdlWindow;
     mRenderer.mTargetOffscreenWidth = 1280;
     mRenderer.mTargetOffscreenHeight = 720;
     mRenderer.startup();
     gRenderer = &mRenderer;
+    gOtsukimi = this;
 
     mPrevTime = SDL_GetPerformanceCounter();
     SDL_Delay(1);
@@ -62,7 +61,9 @@ void Otsukimi::startup()
 
 void Otsukimi::shutdown()
 {
+    mFramePacer.shutdown();
     mRenderer.shutdown();
+    unmountAssetPack();
 
     SDL_Quit();
 }
@@ -78,6 +79,12 @@ void Otsukimi::run()
 
     while (!bQuit)
     {
+        if (mRenderer.mFrameUnchanged)
+        {
+            // nothing on screen changed, sleep until input arrives or the minimum frame rate is due
+            SDL_WaitEventTimeout(nullptr, mRenderer.getIdleTimeoutMS());
+        }
+
         while (SDL_PollEvent(&e) != 0)
         {
             if (e.type == SDL_EVENT_QUIT)
@@ -95,6 +102,7 @@ void Otsukimi::run()
             {
                 SDL_Log("Otsukimi: SDL_EVENT_WINDOW_RESTORED is occured");
                 mStopRendering = false;
+                mRenderer.requestRedraw();
                 mPrevTime = SDL_GetPerformanceCounter();
                 SDL_Delay(1);
             }
@@ -103,10 +111,16 @@ void Otsukimi::run()
             {
                 gRenderer->mScreenWidth = e.window.data1;
                 gRenderer->mScreenHeight = e.window.data2;
+                gRenderer->requestRedraw();
 
                 onResized(e.window.data1, e.window.data2);
             }
 
+            if (e.type == SDL_EVENT_WINDOW_EXPOSED)
+            {
+                mRenderer.requestRedraw();
+            }
+
             if (e.type == SDL_EVENT_MOUSE_MOTION)
             {
                 onMouseMoved(e.motion.x, e.motion.y, e.motion.xrel, e.motion.yrel);
@@ -172,15 +186,29 @@ void Otsukimi::run()
         double dt = double(now - mPrevTime) / SDL_GetPerformanceFrequency();
         mPrevTime = now;
 
+        int ticks = mFixedTimestep.advance(dt);
+        for (int i = 0; i < ticks; ++i)
+        {
+            onFixedUpdate(float(mFixedTimestep.getTickSeconds()));
+        }
+
         onUpdate(dt);
 
+        if (mRenderer.skipUnchangedFrame())
+        {
+            mFramePacer.frameSkipped();
+            continue;
+        }
+
         mRenderer.flush();
 
         mRenderer.postUpdate(0, 0, w, h);
 
-        mRenderer.flush();
+        mRenderer.endFrame();
 
+        mFramePacer.waitForPresent();
         SDL_GL_SwapWindow(mSdlWindow);
+        mFramePacer.framePresented();
     }
 }
 } // namespace gegege::otsukimi
@@ -0,0 +1,14 @@
+#include "../../../include/gegege/otsukimi/asset_pack.hpp"
+
+#include <cstdio>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: otsukimi_pack <data dir> <output pack>\n");
+        return 1;
+    }
+
+    return gegege::otsukimi::writeAssetPack(argv[1], argv[2]) ? 0 : 1;
+}
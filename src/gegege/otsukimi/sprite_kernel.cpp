@@ -0,0 +1,178 @@
+#include "../../../include/gegege/otsukimi/sprite_kernel.hpp"
+
+#include "../../../include/gegege/otsukimi/renderer.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OTSUKIMI_SPRITE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OTSUKIMI_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define OTSUKIMI_TARGET_AVX2
+#endif
+
+namespace gegege::otsukimi {
+
+namespace {
+
+// The 2x3 affine part of glm::translate * glm::rotate * glm::scale.
+// Every product and sum is evaluated in the same order as the glm matrix code it replaces,
+// so the positions match it bit for bit apart from the sign of exact zeros.
+struct QuadTransform {
+    float mM00;
+    float mM01;
+    float mM10;
+    float mM11;
+    float mTX;
+    float mTY;
+    float mHalfW;
+    float mHalfH;
+};
+
+inline QuadTransform makeQuadTransform(const SpriteDesc& sprite)
+{
+    QuadTransform q;
+
+    float c = 1.0f;
+    float s = 0.0f;
+    if (sprite.mAngle != 0.0f)
+    {
+        c = std::cos(sprite.mAngle);
+        s = std::sin(sprite.mAngle);
+    }
+
+    if (sprite.mScaleX == 1.0f && sprite.mScaleY == 1.0f)
+    {
+        q.mM00 = c;
+        q.mM01 = 0.0f + s;
+        q.mM10 = 0.0f - s;
+        q.mM11 = c;
+    }
+    else
+    {
+        q.mM00 = c * sprite.mScaleX;
+        q.mM01 = (0.0f + s) * sprite.mScaleX;
+        q.mM10 = (0.0f - s) * sprite.mScaleY;
+        q.mM11 = c * sprite.mScaleY;
+    }
+
+    q.mTX = 0.0f + sprite.mDX;
+    q.mTY = 0.0f + sprite.mDY;
+    q.mHalfW = sprite.mSW / 2.0f;
+    q.mHalfH = sprite.mSH / 2.0f;
+
+    return q;
+}
+
+void transformSpritesScalar(const SpriteDesc* sprites, size_t count, Vertex* vertices)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        QuadTransform q = makeQuadTransform(sprites[i]);
+        const float xs[4] = {-q.mHalfW, -q.mHalfW, q.mHalfW, q.mHalfW};
+        const float ys[4] = {q.mHalfH, -q.mHalfH, -q.mHalfH, q.mHalfH};
+
+        Vertex* v = vertices + i * 4;
+        for (int k = 0; k < 4; ++k)
+        {
+            v[k].mX = (q.mM00 * xs[k] + q.mM10 * ys[k]) + q.mTX;
+            v[k].mY = (q.mM01 * xs[k] + q.mM11 * ys[k]) + q.mTY;
+        }
+    }
+}
+
+#ifdef OTSUKIMI_SPRITE_KERNEL_X86
+
+// stores lanes (x0 y0 x1 y1) (x2 y2 x3 y3) into the position of 4 consecutive vertices
+inline void storePositions(Vertex* v, __m128 lo, __m128 hi)
+{
+    _mm_storel_pi((__m64*)&v[0].mX, lo);
+    _mm_storeh_pi((__m64*)&v[1].mX, lo);
+    _mm_storel_pi((__m64*)&v[2].mX, hi);
+    _mm_storeh_pi((__m64*)&v[3].mX, hi);
+}
+
+// one quad per iteration, the four corners occupy the four lanes
+void transformSpritesSSE2(const SpriteDesc* sprites, size_t count, Vertex* vertices)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        QuadTransform q = makeQuadTransform(sprites[i]);
+
+        __m128 xs = _mm_setr_ps(-q.mHalfW, -q.mHalfW, q.mHalfW, q.mHalfW);
+        __m128 ys = _mm_setr_ps(q.mHalfH, -q.mHalfH, -q.mHalfH, q.mHalfH);
+
+        __m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(q.mM00), xs), _mm_mul_ps(_mm_set1_ps(q.mM10), ys)), _mm_set1_ps(q.mTX));
+        __m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(q.mM01), xs), _mm_mul_ps(_mm_set1_ps(q.mM11), ys)), _mm_set1_ps(q.mTY));
+
+        storePositions(vertices + i * 4, _mm_unpacklo_ps(px, py), _mm_unpackhi_ps(px, py));
+    }
+}
+
+// two quads per iteration, one in each 128-bit half
+// mul and add are kept separate, an FMA would round differently from the scalar path
+OTSUKIMI_TARGET_AVX2 void transformSpritesAVX2(const SpriteDesc* sprites, size_t count, Vertex* vertices)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        QuadTransform a = makeQuadTransform(sprites[i]);
+        QuadTransform b = makeQuadTransform(sprites[i + 1]);
+
+        __m256 xs = _mm256_setr_ps(-a.mHalfW, -a.mHalfW, a.mHalfW, a.mHalfW, -b.mHalfW, -b.mHalfW, b.mHalfW, b.mHalfW);
+        __m256 ys = _mm256_setr_ps(a.mHalfH, -a.mHalfH, -a.mHalfH, a.mHalfH, b.mHalfH, -b.mHalfH, -b.mHalfH, b.mHalfH);
+        __m256 m00 = _mm256_setr_ps(a.mM00, a.mM00, a.mM00, a.mM00, b.mM00, b.mM00, b.mM00, b.mM00);
+        __m256 m10 = _mm256_setr_ps(a.mM10, a.mM10, a.mM10, a.mM10, b.mM10, b.mM10, b.mM10, b.mM10);
+        __m256 m01 = _mm256_setr_ps(a.mM01, a.mM01, a.mM01, a.mM01, b.mM01, b.mM01, b.mM01, b.mM01);
+        __m256 m11 = _mm256_setr_ps(a.mM11, a.mM11, a.mM11, a.mM11, b.mM11, b.mM11, b.mM11, b.mM11);
+        __m256 tx = _mm256_setr_ps(a.mTX, a.mTX, a.mTX, a.mTX, b.mTX, b.mTX, b.mTX, b.mTX);
+        __m256 ty = _mm256_setr_ps(a.mTY, a.mTY, a.mTY, a.mTY, b.mTY, b.mTY, b.mTY, b.mTY);
+
+        __m256 px = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, xs), _mm256_mul_ps(m10, ys)), tx);
+        __m256 py = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m01, xs), _mm256_mul_ps(m11, ys)), ty);
+
+        __m256 lo = _mm256_unpacklo_ps(px, py);
+        __m256 hi = _mm256_unpackhi_ps(px, py);
+
+        storePositions(vertices + i * 4, _mm256_castps256_ps128(lo), _mm256_castps256_ps128(hi));
+        storePositions(vertices + i * 4 + 4, _mm256_extractf128_ps(lo, 1), _mm256_extractf128_ps(hi, 1));
+    }
+
+    transformSpritesSSE2(sprites + i, count - i, vertices + i * 4);
+}
+
+#endif
+
+using TransformSpritesFn = void (*)(const SpriteDesc*, size_t, Vertex*);
+
+TransformSpritesFn selectTransformSprites()
+{
+#ifdef OTSUKIMI_SPRITE_KERNEL_X86
+    if (SDL_HasAVX2())
+    {
+        SDL_Log("Sprite kernel: AVX2");
+        return transformSpritesAVX2;
+    }
+    if (SDL_HasSSE2())
+    {
+        SDL_Log("Sprite kernel: SSE2");
+        return transformSpritesSSE2;
+    }
+#endif
+    SDL_Log("Sprite kernel: scalar");
+    return transformSpritesScalar;
+}
+
+} // namespace
+
+void transformSprites(const SpriteDesc* sprites, size_t count, Vertex* vertices)
+{
+    static const TransformSpritesFn fn = selectTransformSprites();
+    fn(sprites, count, vertices);
+}
+
+} // namespace gegege::otsukimi
@@ -1,6 +1,6 @@
 #include "../../../include/gegege/otsukimi/util.hpp"
 
-#include "../../../include/gegege/otsukimi/renderer.hpp"
+#include "../../../include/gegege/otsukimi/otsukimi.hpp"
 
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -9,6 +9,7 @@
 namespace gegege::otsukimi {
 
 extern Renderer* gRenderer;
+extern Otsukimi* gOtsukimi;
 
 int getMouseCoordinateToScreenCoordinateX(int mouseX)
 {
@@ -30,4 +31,39 @@ int getMouseCoordinateToScreenCoordinateY(int mouseY)
     return orthoCoords.y;
 }
 
+void setTickRate(double ticksPerSecond)
+{
+    gOtsukimi->mFixedTimestep.setTickRate(ticksPerSecond);
+}
+
+void setMaxCatchUpTicks(int ticks)
+{
+    gOtsukimi->mFixedTimestep.setMaxCatchUpTicks(ticks);
+}
+
+float getInterpolationAlpha()
+{
+    return gOtsukimi->mFixedTimestep.getInterpolationAlpha();
+}
+
+void setPacingMode(PacingMode mode)
+{
+    gOtsukimi->mFramePacer.setMode(mode);
+}
+
+void setFrameRateLimit(double fps)
+{
+    gOtsukimi->mFramePacer.setFrameRateLimit(fps);
+}
+
+void setMaxQueuedFrames(unsigned int frames)
+{
+    gOtsukimi->mFramePacer.setMaxQueuedFrames(frames);
+}
+
+PacingStats getPacingStats()
+{
+    return gOtsukimi->mFramePacer.getStats();
+}
+
 }